@@ -0,0 +1,164 @@
+/**
+ * @file aesd-circular-buffer-arena.c
+ * @brief Functions of the arena circular buffer variant, see aesd-circular-buffer-arena.h
+ *
+ * The live bytes always form one run of used bytes starting at start, wrapping past the end
+ * of the arena at most once, so any byte range is copied with at most two memcpy calls.
+ * Any necessary locking must be handled by the caller.
+ *
+ */
+
+#ifdef __KERNEL__
+#include <linux/string.h>
+#include <linux/errno.h>
+#else
+#include <string.h>
+#include <errno.h>
+#endif
+
+#include "aesd-circular-buffer-arena.h"
+
+/**
+ * @return the arena offset @param advance bytes after @param offset, advance being at most arena_size
+ */
+static uint32_t aesd_arena_wrap(const struct aesd_arena_buffer *buffer, uint32_t offset, size_t advance)
+{
+    uint32_t to_end = buffer->arena_size - offset;
+
+    return advance < to_end ? offset + advance : advance - to_end;
+}
+
+/**
+ * Initialize @param buffer as an empty buffer over the @param arena_size bytes at @param arena and
+ * the @param record_capacity headers at @param record
+ * @return 0 on success, -EINVAL if arena_size is zero or record_capacity is not a power of two
+ */
+int aesd_arena_buffer_init(struct aesd_arena_buffer *buffer, char *arena, uint32_t arena_size,
+            struct aesd_arena_record *record, uint32_t record_capacity)
+{
+    if (arena_size == 0 || record_capacity == 0 || (record_capacity & (record_capacity - 1)) != 0) {
+        return -EINVAL;
+    }
+
+    memset(buffer, 0, sizeof(*buffer));
+    buffer->arena = arena;
+    buffer->arena_size = arena_size;
+    buffer->record = record;
+    buffer->mask = record_capacity - 1;
+    return 0;
+}
+
+/**
+ * Remove the oldest record, giving its bytes back to the arena.
+ * @return false if the buffer was empty
+ */
+bool aesd_arena_buffer_remove_record(struct aesd_arena_buffer *buffer)
+{
+    struct aesd_arena_record *oldest;
+
+    if (aesd_arena_buffer_count(buffer) == 0) {
+        return false;
+    }
+
+    oldest = &buffer->record[buffer->out & buffer->mask];
+    buffer->start = aesd_arena_wrap(buffer, buffer->start, oldest->size);
+    buffer->used -= oldest->size;
+    buffer->out++;
+    if (buffer->used == 0) {
+        buffer->start = 0;
+    }
+    return true;
+}
+
+/**
+ * Copy the @param size bytes at @param data into the arena as the newest record, removing the
+ * oldest records until both its bytes and its header fit.
+ * @return the number of records removed to make room, or -EINVAL if size exceeds the arena
+ */
+int aesd_arena_buffer_add_record(struct aesd_arena_buffer *buffer, const char *data, size_t size)
+{
+    struct aesd_arena_record *record;
+    uint32_t offset;
+    uint32_t first;
+    int removed = 0;
+
+    if (size > buffer->arena_size) {
+        return -EINVAL;
+    }
+
+    while (buffer->used + size > buffer->arena_size || aesd_arena_buffer_count(buffer) > buffer->mask) {
+        aesd_arena_buffer_remove_record(buffer);
+        removed++;
+    }
+
+    offset = aesd_arena_wrap(buffer, buffer->start, buffer->used);
+    first = buffer->arena_size - offset;
+    if (size <= first) {
+        memcpy(buffer->arena + offset, data, size);
+    } else {
+        memcpy(buffer->arena + offset, data, first);
+        memcpy(buffer->arena, data + first, size - first);
+    }
+
+    record = &buffer->record[buffer->in & buffer->mask];
+    record->offset = offset;
+    record->size = size;
+    buffer->used += size;
+    buffer->in++;
+    return removed;
+}
+
+/**
+ * @return the record holding the zero referenced byte @param char_offset of the concatenated
+ * records, with the offset of that byte within it stored at @param record_offset_byte_rtn, or
+ * NULL if not enough data is written.
+ */
+struct aesd_arena_record *aesd_arena_buffer_find_record_offset_for_fpos(struct aesd_arena_buffer *buffer,
+            size_t char_offset, size_t *record_offset_byte_rtn)
+{
+    struct aesd_arena_record *record;
+    uint32_t counter;
+
+    if (char_offset >= buffer->used) {
+        return NULL;
+    }
+
+    for (counter = buffer->out; counter != buffer->in; counter++) {
+        record = &buffer->record[counter & buffer->mask];
+        if (char_offset < record->size) {
+            *record_offset_byte_rtn = char_offset;
+            return record;
+        }
+        char_offset -= record->size;
+    }
+    return NULL;
+}
+
+/**
+ * Copy up to @param len bytes starting at byte @param char_offset of the concatenated records
+ * to @param dest, crossing record boundaries.
+ * @return the number of bytes copied, zero once char_offset reaches the end of the data
+ */
+size_t aesd_arena_buffer_copy(const struct aesd_arena_buffer *buffer, size_t char_offset, char *dest,
+            size_t len)
+{
+    uint32_t offset;
+    uint32_t first;
+
+    if (char_offset >= buffer->used) {
+        return 0;
+    }
+    if (len > buffer->used - char_offset) {
+        len = buffer->used - char_offset;
+    }
+
+    offset = aesd_arena_wrap(buffer, buffer->start, char_offset);
+    first = buffer->arena_size - offset;
+    if (len <= first) {
+        memcpy(dest, buffer->arena + offset, len);
+    } else {
+        memcpy(dest, buffer->arena + offset, first);
+        memcpy(dest + first, buffer->arena, len - first);
+    }
+    return len;
+}
@@ -0,0 +1,76 @@
+/*
+ * aesd-circular-buffer-arena.h
+ *
+ *  @brief A variant of aesd-circular-buffer.h storing the bytes of every record back to back
+ *  in one preallocated arena, with a table of (offset, size) headers instead of a pointer per
+ *  entry.  Adding a record copies it into the arena and never allocates; replaying the history
+ *  is a scan of the arena which wraps at most once.
+ */
+
+#ifndef AESD_CIRCULAR_BUFFER_ARENA_H
+#define AESD_CIRCULAR_BUFFER_ARENA_H
+
+#include "aesd-circular-buffer.h"
+
+/**
+ * Location of one record in the arena.  A record reaching the end of the arena continues at
+ * its start.
+ */
+struct aesd_arena_record
+{
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct aesd_arena_buffer
+{
+    /**
+     * Caller provided storage for the record bytes
+     */
+    char *arena;
+    uint32_t arena_size;
+    /**
+     * Caller provided table of record headers, its capacity being a power of two
+     */
+    struct aesd_arena_record *record;
+    uint32_t mask;
+    /**
+     * Number of records ever added and removed, the oldest one is at record[out & mask]
+     */
+    uint32_t in;
+    uint32_t out;
+    /**
+     * Offset in arena of the first byte of the oldest record, and number of bytes held
+     */
+    uint32_t start;
+    uint32_t used;
+};
+
+static inline uint32_t aesd_arena_buffer_count(const struct aesd_arena_buffer *buffer)
+{
+    return buffer->in - buffer->out;
+}
+
+/**
+ * @return the zero referenced @param index record counting from the oldest one, which must be
+ * below aesd_arena_buffer_count()
+ */
+static inline struct aesd_arena_record *aesd_arena_buffer_at(struct aesd_arena_buffer *buffer, uint32_t index)
+{
+    return &buffer->record[(buffer->out + index) & buffer->mask];
+}
+
+extern int aesd_arena_buffer_init(struct aesd_arena_buffer *buffer, char *arena, uint32_t arena_size,
+            struct aesd_arena_record *record, uint32_t record_capacity);
+
+extern int aesd_arena_buffer_add_record(struct aesd_arena_buffer *buffer, const char *data, size_t size);
+
+extern bool aesd_arena_buffer_remove_record(struct aesd_arena_buffer *buffer);
+
+extern struct aesd_arena_record *aesd_arena_buffer_find_record_offset_for_fpos(struct aesd_arena_buffer *buffer,
+            size_t char_offset, size_t *record_offset_byte_rtn);
+
+extern size_t aesd_arena_buffer_copy(const struct aesd_arena_buffer *buffer, size_t char_offset, char *dest,
+            size_t len);
+
+#endif /* AESD_CIRCULAR_BUFFER_ARENA_H */
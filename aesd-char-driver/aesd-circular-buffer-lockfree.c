@@ -0,0 +1,174 @@
+/**
+ * @file aesd-circular-buffer-lockfree.c
+ * @brief Lock-free single and multi producer circular buffers, see aesd-circular-buffer-lockfree.h
+ *
+ * Counters run freely and are masked into the storage, so the number of queued entries is
+ * always a wrapping difference of two counters.
+ *
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "aesd-circular-buffer-lockfree.h"
+
+static bool aesd_is_pow2(uint32_t capacity)
+{
+    return capacity != 0 && (capacity & (capacity - 1)) == 0;
+}
+
+/*               SPSC               */
+
+/**
+ * Initialize @param buffer as an empty buffer over the @param capacity entries at @param storage.
+ * Must complete before the producer and consumer threads use the buffer.
+ * @return 0 on success, -EINVAL if capacity is not a power of two
+ */
+int aesd_spsc_buffer_init(struct aesd_spsc_buffer *buffer, struct aesd_buffer_entry *storage,
+            uint32_t capacity)
+{
+    if (!aesd_is_pow2(capacity)) {
+        return -EINVAL;
+    }
+
+    memset(storage, 0, capacity * sizeof(*storage));
+    buffer->entry = storage;
+    buffer->mask = capacity - 1;
+    atomic_init(&buffer->head, 0);
+    atomic_init(&buffer->tail, 0);
+    buffer->tail_cache = 0;
+    buffer->head_cache = 0;
+    return 0;
+}
+
+/**
+ * Add @param add_entry as the newest entry.  Only one thread may push.
+ * @return false if the buffer is full
+ */
+bool aesd_spsc_buffer_push(struct aesd_spsc_buffer *buffer, const struct aesd_buffer_entry *add_entry)
+{
+    uint32_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+
+    if (head - buffer->tail_cache > buffer->mask) {
+        buffer->tail_cache = atomic_load_explicit(&buffer->tail, memory_order_acquire);
+        if (head - buffer->tail_cache > buffer->mask) {
+            return false;
+        }
+    }
+
+    buffer->entry[head & buffer->mask] = *add_entry;
+    atomic_store_explicit(&buffer->head, head + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * Remove the oldest entry into @param entry_rtn.  Only one thread may pop.
+ * @return false if the buffer is empty
+ */
+bool aesd_spsc_buffer_pop(struct aesd_spsc_buffer *buffer, struct aesd_buffer_entry *entry_rtn)
+{
+    uint32_t tail = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+
+    if (tail == buffer->head_cache) {
+        buffer->head_cache = atomic_load_explicit(&buffer->head, memory_order_acquire);
+        if (tail == buffer->head_cache) {
+            return false;
+        }
+    }
+
+    *entry_rtn = buffer->entry[tail & buffer->mask];
+    atomic_store_explicit(&buffer->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+/*               MPMC               */
+
+/**
+ * Initialize @param buffer as an empty buffer over the @param capacity cells at @param storage.
+ * Must complete before other threads use the buffer.
+ * @return 0 on success, -EINVAL if capacity is not a power of two
+ */
+int aesd_mpmc_buffer_init(struct aesd_mpmc_buffer *buffer, struct aesd_mpmc_cell *storage,
+            uint32_t capacity)
+{
+    uint32_t i;
+
+    if (!aesd_is_pow2(capacity)) {
+        return -EINVAL;
+    }
+
+    for (i = 0; i < capacity; i++) {
+        atomic_init(&storage[i].sequence, i);
+        storage[i].entry.buffptr = NULL;
+        storage[i].entry.size = 0;
+    }
+    buffer->cell = storage;
+    buffer->mask = capacity - 1;
+    atomic_init(&buffer->enqueue_pos, 0);
+    atomic_init(&buffer->dequeue_pos, 0);
+    return 0;
+}
+
+/**
+ * Add @param add_entry as the newest entry, from any thread.
+ * @return false if the buffer is full
+ */
+bool aesd_mpmc_buffer_push(struct aesd_mpmc_buffer *buffer, const struct aesd_buffer_entry *add_entry)
+{
+    struct aesd_mpmc_cell *cell;
+    uint32_t pos = atomic_load_explicit(&buffer->enqueue_pos, memory_order_relaxed);
+    int32_t diff;
+
+    for (;;) {
+        cell = &buffer->cell[pos & buffer->mask];
+        diff = (int32_t)(atomic_load_explicit(&cell->sequence, memory_order_acquire) - pos);
+        if (diff == 0) {
+            /* The cell is free for this position, claim the position */
+            if (atomic_compare_exchange_weak_explicit(&buffer->enqueue_pos, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /* The cell still holds the entry from one lap ago */
+            return false;
+        } else {
+            pos = atomic_load_explicit(&buffer->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    cell->entry = *add_entry;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * Remove the oldest entry into @param entry_rtn, from any thread.
+ * @return false if the buffer is empty
+ */
+bool aesd_mpmc_buffer_pop(struct aesd_mpmc_buffer *buffer, struct aesd_buffer_entry *entry_rtn)
+{
+    struct aesd_mpmc_cell *cell;
+    uint32_t pos = atomic_load_explicit(&buffer->dequeue_pos, memory_order_relaxed);
+    int32_t diff;
+
+    for (;;) {
+        cell = &buffer->cell[pos & buffer->mask];
+        diff = (int32_t)(atomic_load_explicit(&cell->sequence, memory_order_acquire) - (pos + 1));
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&buffer->dequeue_pos, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /* No producer has filled this position yet */
+            return false;
+        } else {
+            pos = atomic_load_explicit(&buffer->dequeue_pos, memory_order_relaxed);
+        }
+    }
+
+    *entry_rtn = cell->entry;
+    /* Free the cell for the producer one lap ahead */
+    atomic_store_explicit(&cell->sequence, pos + buffer->mask + 1, memory_order_release);
+    return true;
+}
@@ -0,0 +1,82 @@
+/*
+ * aesd-circular-buffer-lockfree.h
+ *
+ *  @brief Lock-free variants of aesd-circular-buffer.h for userspace, handing struct
+ *  aesd_buffer_entry values between threads without a mutex.
+ *
+ *  Unlike struct aesd_circular_buffer these never overwrite the oldest entry: a producer
+ *  cannot free memory a consumer may be reading, so a push to a full buffer fails instead.
+ *  Entry storage is provided by the caller and its capacity must be a power of two.
+ */
+
+#ifndef AESD_CIRCULAR_BUFFER_LOCKFREE_H
+#define AESD_CIRCULAR_BUFFER_LOCKFREE_H
+
+#ifdef __KERNEL__
+#error "aesd-circular-buffer-lockfree.h is for userspace builds only"
+#endif
+
+#include <stdalign.h>
+#include <stdatomic.h>
+
+#include "aesd-circular-buffer.h"
+
+/**
+ * Indices written by different threads are kept this far apart so they never share a cache line
+ */
+#define AESD_CACHE_LINE_SIZE 64
+
+/**
+ * Single producer, single consumer buffer.  Each side owns one index and keeps a cached copy
+ * of the other, only reloading it when the cached value says the buffer is full or empty.
+ */
+struct aesd_spsc_buffer
+{
+    struct aesd_buffer_entry *entry;
+    uint32_t mask;
+    /**
+     * Producer side: number of entries ever pushed, and the last tail it loaded
+     */
+    alignas(AESD_CACHE_LINE_SIZE) _Atomic uint32_t head;
+    uint32_t tail_cache;
+    /**
+     * Consumer side: number of entries ever popped, and the last head it loaded
+     */
+    alignas(AESD_CACHE_LINE_SIZE) _Atomic uint32_t tail;
+    uint32_t head_cache;
+};
+
+extern int aesd_spsc_buffer_init(struct aesd_spsc_buffer *buffer, struct aesd_buffer_entry *storage,
+            uint32_t capacity);
+extern bool aesd_spsc_buffer_push(struct aesd_spsc_buffer *buffer, const struct aesd_buffer_entry *add_entry);
+extern bool aesd_spsc_buffer_pop(struct aesd_spsc_buffer *buffer, struct aesd_buffer_entry *entry_rtn);
+
+/**
+ * A slot of struct aesd_mpmc_buffer.  sequence tells whose turn it is: equal to the position
+ * when a producer may fill it, position + 1 once it holds an entry for the consumer.
+ */
+struct aesd_mpmc_cell
+{
+    _Atomic uint32_t sequence;
+    struct aesd_buffer_entry entry;
+};
+
+/**
+ * Multi producer, multi consumer buffer after Dmitry Vyukov's bounded queue.  Producers and
+ * consumers claim positions with a compare and swap on their own index, then hand the entry
+ * over through the cell sequence.
+ */
+struct aesd_mpmc_buffer
+{
+    struct aesd_mpmc_cell *cell;
+    uint32_t mask;
+    alignas(AESD_CACHE_LINE_SIZE) _Atomic uint32_t enqueue_pos;
+    alignas(AESD_CACHE_LINE_SIZE) _Atomic uint32_t dequeue_pos;
+};
+
+extern int aesd_mpmc_buffer_init(struct aesd_mpmc_buffer *buffer, struct aesd_mpmc_cell *storage,
+            uint32_t capacity);
+extern bool aesd_mpmc_buffer_push(struct aesd_mpmc_buffer *buffer, const struct aesd_buffer_entry *add_entry);
+extern bool aesd_mpmc_buffer_pop(struct aesd_mpmc_buffer *buffer, struct aesd_buffer_entry *entry_rtn);
+
+#endif /* AESD_CIRCULAR_BUFFER_LOCKFREE_H */
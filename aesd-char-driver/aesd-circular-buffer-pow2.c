@@ -0,0 +1,95 @@
+/**
+ * @file aesd-circular-buffer-pow2.c
+ * @brief Functions of the power of two circular buffer variant, see aesd-circular-buffer-pow2.h
+ *
+ * Same contract as aesd-circular-buffer.c: any necessary locking must be handled by the caller
+ * and the memory referenced by entries is owned by the caller.
+ *
+ */
+
+#ifdef __KERNEL__
+#include <linux/string.h>
+#include <linux/errno.h>
+#else
+#include <string.h>
+#include <errno.h>
+#endif
+
+#include "aesd-circular-buffer-pow2.h"
+
+/**
+ * Initialize @param buffer as an empty buffer over the @param capacity entries at @param storage
+ * @return 0 on success, -EINVAL if capacity is not a power of two
+ */
+int aesd_pow2_buffer_init(struct aesd_pow2_buffer *buffer, struct aesd_buffer_entry *storage,
+            uint32_t capacity)
+{
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return -EINVAL;
+    }
+
+    memset(storage, 0, capacity * sizeof(*storage));
+    buffer->entry = storage;
+    buffer->mask = capacity - 1;
+    buffer->in = 0;
+    buffer->out = 0;
+    return 0;
+}
+
+/**
+ * Like aesd_circular_buffer_find_entry_offset_for_fpos(), only visiting live entries.
+ * @return the entry holding the zero referenced byte @param char_offset of the concatenated entries,
+ * with the offset of that byte within it stored at @param entry_offset_byte_rtn, or NULL if
+ * not enough data is written.
+ */
+struct aesd_buffer_entry *aesd_pow2_buffer_find_entry_offset_for_fpos(struct aesd_pow2_buffer *buffer,
+            size_t char_offset, size_t *entry_offset_byte_rtn)
+{
+    struct aesd_buffer_entry *entry;
+    uint32_t counter;
+
+    AESD_POW2_BUFFER_FOREACH_LIVE(entry, buffer, counter) {
+        if (char_offset < entry->size) {
+            *entry_offset_byte_rtn = char_offset;
+            return entry;
+        }
+        char_offset -= entry->size;
+    }
+    return NULL;
+}
+
+/**
+ * Add @param add_entry as the newest entry, overwriting the oldest one when the buffer is full.
+ * @return NULL or, if an existing entry was replaced, the value of buffptr for the entry
+ * which was replaced, so the caller can free it.
+ */
+const char *aesd_pow2_buffer_add_entry(struct aesd_pow2_buffer *buffer, const struct aesd_buffer_entry *add_entry)
+{
+    const char *replaced = NULL;
+
+    if (aesd_pow2_buffer_full(buffer)) {
+        replaced = buffer->entry[buffer->out & buffer->mask].buffptr;
+        buffer->out++;
+    }
+    buffer->entry[buffer->in & buffer->mask] = *add_entry;
+    buffer->in++;
+    return replaced;
+}
+
+/**
+ * Remove the oldest entry.
+ * @return NULL if the buffer was empty or the value of buffptr for the entry which was removed,
+ * so the caller can free it.
+ */
+const char *aesd_pow2_buffer_remove_entry(struct aesd_pow2_buffer *buffer)
+{
+    struct aesd_buffer_entry *oldest;
+
+    if (aesd_pow2_buffer_count(buffer) == 0) {
+        return NULL;
+    }
+
+    oldest = &buffer->entry[buffer->out & buffer->mask];
+    buffer->out++;
+    return oldest->buffptr;
+}
@@ -0,0 +1,80 @@
+/*
+ * aesd-circular-buffer-pow2.h
+ *
+ *  @brief A variant of aesd-circular-buffer.h whose capacity is a power of two.  in and out
+ *  count every entry ever added and removed and are masked into the entry array, so no
+ *  step divides and the number of live entries is simply in - out.
+ */
+
+#ifndef AESD_CIRCULAR_BUFFER_POW2_H
+#define AESD_CIRCULAR_BUFFER_POW2_H
+
+#include "aesd-circular-buffer.h"
+
+struct aesd_pow2_buffer
+{
+    /**
+     * Caller provided array of capacity entries, capacity being a power of two
+     */
+    struct aesd_buffer_entry *entry;
+    /**
+     * capacity - 1, turning a counter into an index of entry
+     */
+    uint32_t mask;
+    /**
+     * Number of entries ever added, the next one is stored at entry[in & mask]
+     */
+    uint32_t in;
+    /**
+     * Number of entries ever removed or overwritten, the oldest one is at entry[out & mask]
+     */
+    uint32_t out;
+};
+
+static inline uint32_t aesd_pow2_buffer_count(const struct aesd_pow2_buffer *buffer)
+{
+    return buffer->in - buffer->out;
+}
+
+static inline bool aesd_pow2_buffer_full(const struct aesd_pow2_buffer *buffer)
+{
+    return aesd_pow2_buffer_count(buffer) > buffer->mask;
+}
+
+/**
+ * @return the zero referenced @param index entry counting from the oldest one, which must be
+ * below aesd_pow2_buffer_count()
+ */
+static inline struct aesd_buffer_entry *aesd_pow2_buffer_at(struct aesd_pow2_buffer *buffer, uint32_t index)
+{
+    return &buffer->entry[(buffer->out + index) & buffer->mask];
+}
+
+extern int aesd_pow2_buffer_init(struct aesd_pow2_buffer *buffer, struct aesd_buffer_entry *storage,
+            uint32_t capacity);
+
+extern struct aesd_buffer_entry *aesd_pow2_buffer_find_entry_offset_for_fpos(struct aesd_pow2_buffer *buffer,
+            size_t char_offset, size_t *entry_offset_byte_rtn);
+
+extern const char *aesd_pow2_buffer_add_entry(struct aesd_pow2_buffer *buffer, const struct aesd_buffer_entry *add_entry);
+
+extern const char *aesd_pow2_buffer_remove_entry(struct aesd_pow2_buffer *buffer);
+
+/**
+ * Iterate over the live entries of the buffer only, from oldest to newest.
+ * @param entryptr is a struct aesd_buffer_entry* to set with the current entry
+ * @param buffer is the struct aesd_pow2_buffer * describing the buffer
+ * @param counter is a uint32_t stack allocated value used by this macro, running from out to in
+ * Example usage:
+ * uint32_t counter;
+ * struct aesd_buffer_entry *entry;
+ * AESD_POW2_BUFFER_FOREACH_LIVE(entry,&buffer,counter) {
+ *      total += entry->size;
+ * }
+ */
+#define AESD_POW2_BUFFER_FOREACH_LIVE(entryptr,buffer,counter) \
+    for(counter=(buffer)->out; \
+            counter!=(buffer)->in && ((entryptr)=&((buffer)->entry[counter & (buffer)->mask]), 1); \
+            counter++)
+
+#endif /* AESD_CIRCULAR_BUFFER_POW2_H */
@@ -58,12 +58,16 @@ struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos(struct
 * new start location.
 * Any necessary locking must be handled by the caller
 * Any memory referenced in @param add_entry must be allocated by and/or must have a lifetime managed by the caller.
+* @return NULL or, if an existing entry at out_offs was replaced, the value of buffptr for the entry
+* which was replaced, so the caller can free it.
 */
-void aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const struct aesd_buffer_entry *add_entry)
+const char *aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const struct aesd_buffer_entry *add_entry)
 {
-    /**
-    * TODO: implement per description
-    */
+    const char *replaced = NULL;
+
+    if(buffer->full) {
+        replaced = buffer->entry[buffer->in_offs].buffptr;
+    }
     buffer->entry[buffer->in_offs] = *add_entry;
    
     if(buffer->full) {
@@ -73,6 +77,185 @@ void aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const s
 	buffer->full = (buffer->in_offs == buffer->out_offs);
 
     //printf("\n buffer->in_offs: %d, buffer->out_offs:%d \n", buffer->in_offs, buffer->out_offs);
+    return replaced;
+}
+
+/**
+* Removes the oldest entry of @param buffer, at buffer->out_offs, and advances buffer->out_offs.
+* Any necessary locking must be handled by the caller
+* @return NULL if the buffer was empty or the value of buffptr for the entry which was removed,
+* so the caller can free it.
+*/
+const char *aesd_circular_buffer_remove_entry(struct aesd_circular_buffer *buffer)
+{
+    const char *removed;
+
+    if(!buffer->full && buffer->in_offs == buffer->out_offs) {
+        return NULL;
+    }
+
+    removed = buffer->entry[buffer->out_offs].buffptr;
+    buffer->entry[buffer->out_offs].buffptr = NULL;
+    buffer->entry[buffer->out_offs].size = 0;
+    buffer->out_offs = (buffer->out_offs + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    buffer->full = false;
+
+    return removed;
+}
+
+/**
+* Adds the @param count entries at @param add_entries, oldest first, as if by calling
+* aesd_circular_buffer_add_entry() for each, but updating the offsets once.
+* Any necessary locking must be handled by the caller
+* @param replaced_rtn receives the buffptr of every entry overwritten, including entries of this
+* batch overwritten by later ones, and must have room for count pointers.
+* @return the number of pointers stored in replaced_rtn, so the caller can free them.
+*/
+size_t aesd_circular_buffer_add_entries(struct aesd_circular_buffer *buffer,
+            const struct aesd_buffer_entry *add_entries, size_t count, const char **replaced_rtn)
+{
+    size_t replaced = 0;
+    size_t held = aesd_circular_buffer_count(buffer);
+    size_t skip = 0;
+    size_t overwrite;
+    uint8_t index = buffer->out_offs;
+    size_t i;
+
+    /* Entries followed by a full buffer's worth of newer ones never land in the buffer */
+    if (count > AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) {
+        skip = count - AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    }
+    overwrite = held + count - skip > AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED ?
+            held + count - skip - AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED : 0;
+
+    for (i = 0; i < overwrite; i++) {
+        replaced_rtn[replaced++] = buffer->entry[index].buffptr;
+        if (++index == AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) {
+            index = 0;
+        }
+    }
+    for (i = 0; i < skip; i++) {
+        replaced_rtn[replaced++] = add_entries[i].buffptr;
+    }
+
+    index = (buffer->in_offs + skip) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    for (i = skip; i < count; i++) {
+        buffer->entry[index] = add_entries[i];
+        if (++index == AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) {
+            index = 0;
+        }
+    }
+
+    if (count > 0) {
+        buffer->in_offs = index;
+        if (overwrite > 0 || held + count - skip == AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) {
+            buffer->out_offs = index;
+            buffer->full = true;
+        }
+    }
+    return replaced;
+}
+
+/**
+* Copies up to @param max of the oldest entries of @param buffer to @param entries_rtn, oldest first,
+* leaving them in the buffer.
+* Any necessary locking must be handled by the caller
+* @return the number of entries copied
+*/
+uint8_t aesd_circular_buffer_peek_entries(struct aesd_circular_buffer *buffer,
+            struct aesd_buffer_entry *entries_rtn, uint8_t max)
+{
+    uint8_t count = aesd_circular_buffer_count(buffer);
+    uint8_t index = buffer->out_offs;
+    uint8_t i;
+
+    if (count > max) {
+        count = max;
+    }
+    for (i = 0; i < count; i++) {
+        entries_rtn[i] = buffer->entry[index];
+        if (++index == AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) {
+            index = 0;
+        }
+    }
+    return count;
+}
+
+/**
+* Removes up to @param max of the oldest entries of @param buffer into @param entries_rtn, oldest first.
+* Any necessary locking must be handled by the caller
+* @return the number of entries removed, whose buffptr the caller now owns.
+*/
+uint8_t aesd_circular_buffer_pop_entries(struct aesd_circular_buffer *buffer,
+            struct aesd_buffer_entry *entries_rtn, uint8_t max)
+{
+    uint8_t count = aesd_circular_buffer_peek_entries(buffer, entries_rtn, max);
+    uint8_t i;
+
+    for (i = 0; i < count; i++) {
+        buffer->entry[buffer->out_offs].buffptr = NULL;
+        buffer->entry[buffer->out_offs].size = 0;
+        if (++buffer->out_offs == AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) {
+            buffer->out_offs = 0;
+        }
+    }
+    if (count > 0) {
+        buffer->full = false;
+    }
+    return count;
+}
+
+/**
+* Describes the bytes from @param char_offset to @param char_offset + @param len of the concatenated
+* entries as up to @param iov_max elements of @param iov, one per entry touched, without copying.
+* The elements point into the entries, so the caller must keep them alive, and hold any lock,
+* until the vector has been used.
+* @param len_rtn receives the number of bytes described, which is short when the data ends first
+* or iov_max elements were not enough.
+* @return the number of elements filled
+*/
+int aesd_circular_buffer_gather(struct aesd_circular_buffer *buffer, size_t char_offset, size_t len,
+            aesd_iovec *iov, int iov_max, size_t *len_rtn)
+{
+    struct aesd_buffer_entry *entry;
+    size_t entry_offset_byte;
+    size_t chunk;
+    size_t total = 0;
+    int count = 0;
+    uint8_t index;
+    uint8_t remaining;
+
+    *len_rtn = 0;
+    entry = aesd_circular_buffer_find_entry_offset_for_fpos(buffer, char_offset, &entry_offset_byte);
+    if (entry == NULL) {
+        return 0;
+    }
+
+    index = entry - buffer->entry;
+    remaining = aesd_circular_buffer_count(buffer) -
+            (index >= buffer->out_offs ? index - buffer->out_offs :
+                    AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - buffer->out_offs + index);
+
+    while (total < len && count < iov_max && remaining > 0) {
+        entry = &buffer->entry[index];
+        chunk = entry->size - entry_offset_byte;
+        if (chunk > len - total) {
+            chunk = len - total;
+        }
+        iov[count].iov_base = (void *)(entry->buffptr + entry_offset_byte);
+        iov[count].iov_len = chunk;
+        count++;
+        total += chunk;
+
+        entry_offset_byte = 0;
+        remaining--;
+        if (++index == AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) {
+            index = 0;
+        }
+    }
+
+    *len_rtn = total;
+    return count;
 }
 
 /**
@@ -10,10 +10,20 @@
 
 #ifdef __KERNEL__
 #include <linux/types.h>
+#include <linux/uio.h>
+/**
+ * Element filled by aesd_circular_buffer_gather(), ready for kernel_sendmsg()
+ */
+typedef struct kvec aesd_iovec;
 #else
 #include <stddef.h> // size_t
 #include <stdint.h> // uintx_t
 #include <stdbool.h>
+#include <sys/uio.h>
+/**
+ * Element filled by aesd_circular_buffer_gather(), ready for writev() or sendmsg()
+ */
+typedef struct iovec aesd_iovec;
 #endif
 
 #define AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED 10
@@ -51,10 +61,38 @@ struct aesd_circular_buffer
     bool full;
 };
 
+/**
+ * @return the number of entries held by @param buffer
+ */
+static inline uint8_t aesd_circular_buffer_count(const struct aesd_circular_buffer *buffer)
+{
+    if (buffer->full) {
+        return AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    }
+    if (buffer->in_offs >= buffer->out_offs) {
+        return buffer->in_offs - buffer->out_offs;
+    }
+    return AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - buffer->out_offs + buffer->in_offs;
+}
+
 extern struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos(struct aesd_circular_buffer *buffer,
             size_t char_offset, size_t *entry_offset_byte_rtn );
 
-extern void aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const struct aesd_buffer_entry *add_entry);
+extern const char *aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const struct aesd_buffer_entry *add_entry);
+
+extern const char *aesd_circular_buffer_remove_entry(struct aesd_circular_buffer *buffer);
+
+extern size_t aesd_circular_buffer_add_entries(struct aesd_circular_buffer *buffer,
+            const struct aesd_buffer_entry *add_entries, size_t count, const char **replaced_rtn);
+
+extern uint8_t aesd_circular_buffer_peek_entries(struct aesd_circular_buffer *buffer,
+            struct aesd_buffer_entry *entries_rtn, uint8_t max);
+
+extern uint8_t aesd_circular_buffer_pop_entries(struct aesd_circular_buffer *buffer,
+            struct aesd_buffer_entry *entries_rtn, uint8_t max);
+
+extern int aesd_circular_buffer_gather(struct aesd_circular_buffer *buffer, size_t char_offset, size_t len,
+            aesd_iovec *iov, int iov_max, size_t *len_rtn);
 
 extern void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer);
 
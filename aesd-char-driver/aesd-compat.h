@@ -0,0 +1,212 @@
+/*
+ * aesd-compat.h
+ *
+ *  @brief Userspace stand-ins for the kernel interfaces used by aesd-core.c, so the driver
+ *  logic can be built and measured by the harness without loading the module
+ *
+ *  Mutexes and wait queues map onto pthreads, allocations onto malloc, copies to and from
+ *  user space onto memcpy and per CPU counters onto relaxed atomics.  Tracepoints compile away.
+ */
+
+#ifndef AESD_CHAR_DRIVER_AESD_COMPAT_H_
+#define AESD_CHAR_DRIVER_AESD_COMPAT_H_
+
+#ifdef __KERNEL__
+#error "aesd-compat.h is for userspace builds only"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+
+#define __user
+#define __percpu
+
+/**
+ * Only returned by interrupted waits, which never happen in userspace
+ */
+#define ERESTARTSYS 512
+#define MAX_RW_COUNT (INT_MAX & ~4095)
+
+#define READ_ONCE(x) (*(const volatile __typeof__(x) *)&(x))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define min_t(type, a, b) ((type)(a) < (type)(b) ? (type)(a) : (type)(b))
+#define ilog2(n) (63 - __builtin_clzll((unsigned long long)(n)))
+#define u64_to_user_ptr(x) ((void *)(uintptr_t)(x))
+
+/**
+ * Runtime switch for PDEBUG, the counterpart of the aesd_debug module parameter
+ */
+extern bool aesd_debug;
+
+/**
+ * printk stand-in used by PDEBUG.  Kernel format strings assume loff_t and u64 are long long,
+ * which has the same size but not the same type as glibc's, so no format checking here.
+ */
+extern void aesd_debug_printf(const char *fmt, ...);
+
+/*          ALLOCATION             */
+
+#define GFP_KERNEL 0
+#define GFP_KERNEL_ACCOUNT 0
+#define kmalloc(size, flags) malloc(size)
+#define kzalloc(size, flags) calloc(1, (size))
+#define krealloc(ptr, size, flags) realloc((void *)(ptr), (size))
+#define kfree(ptr) free((void *)(ptr))
+#define kvmalloc(size, flags) malloc(size)
+#define kvmalloc_array(n, size, flags) malloc((n) * (size))
+#define kvfree(ptr) free((void *)(ptr))
+
+/**
+ * Size of the kmalloc cache serving @param size, as the power of two caches of the kernel
+ */
+static inline size_t kmalloc_size_roundup(size_t size)
+{
+    size_t bucket = 8;
+
+    while (bucket < size) {
+        bucket *= 2;
+    }
+    return bucket;
+}
+#define alloc_percpu(type) ((type *)calloc(1, sizeof(type)))
+#define free_percpu(ptr) free(ptr)
+
+static inline unsigned long copy_to_user(void *to, const void *from, unsigned long n)
+{
+    memcpy(to, from, n);
+    return 0;
+}
+
+static inline unsigned long copy_from_user(void *to, const void *from, unsigned long n)
+{
+    memcpy(to, from, n);
+    return 0;
+}
+
+/*          ATOMICS & PER CPU      */
+
+typedef struct {
+    long counter;
+} atomic_long_t;
+
+#define atomic_long_read(v) __atomic_load_n(&(v)->counter, __ATOMIC_RELAXED)
+#define atomic_long_add(i, v) __atomic_fetch_add(&(v)->counter, (i), __ATOMIC_RELAXED)
+#define atomic_long_sub(i, v) __atomic_fetch_sub(&(v)->counter, (i), __ATOMIC_RELAXED)
+
+/**
+ * All threads share one copy of the per CPU counters
+ */
+#define this_cpu_add(var, n) __atomic_fetch_add(&(var), (n), __ATOMIC_RELAXED)
+#define this_cpu_inc(var) this_cpu_add(var, 1)
+
+struct kref {
+    int refcount;
+};
+
+/*          PROCESSES              */
+
+/**
+ * The harness is a single thread group, so every file has the same owner
+ */
+struct pid;
+
+#define current NULL
+#define task_tgid(task) ((struct pid *)(uintptr_t)getpid())
+#define get_pid(pid) (pid)
+#define put_pid(pid) ((void)(pid))
+
+/*          LOCKING                */
+
+struct mutex {
+    pthread_mutex_t m;
+};
+
+#define mutex_init(lock) pthread_mutex_init(&(lock)->m, NULL)
+#define mutex_lock(lock) pthread_mutex_lock(&(lock)->m)
+#define mutex_unlock(lock) pthread_mutex_unlock(&(lock)->m)
+#define mutex_trylock(lock) (pthread_mutex_trylock(&(lock)->m) == 0)
+#define mutex_lock_interruptible(lock) (pthread_mutex_lock(&(lock)->m), 0)
+
+/**
+ * A wait queue is a condition variable with its own mutex.  Conditions are evaluated under
+ * that mutex and wake ups take it, so a change made before a wake up is never missed.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} wait_queue_head_t;
+
+static inline void init_waitqueue_head(wait_queue_head_t *wq)
+{
+    pthread_mutex_init(&wq->lock, NULL);
+    pthread_cond_init(&wq->cond, NULL);
+}
+
+static inline void wake_up_interruptible(wait_queue_head_t *wq)
+{
+    pthread_mutex_lock(&wq->lock);
+    pthread_cond_broadcast(&wq->cond);
+    pthread_mutex_unlock(&wq->lock);
+}
+
+#define wait_event_interruptible(wq, condition) ({ \
+    pthread_mutex_lock(&(wq).lock); \
+    while (!(condition)) { \
+        pthread_cond_wait(&(wq).cond, &(wq).lock); \
+    } \
+    pthread_mutex_unlock(&(wq).lock); \
+    0; \
+})
+
+static inline u64 ktime_get_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*          FILES                  */
+
+struct file {
+    void *private_data;
+    unsigned int f_flags;
+    loff_t f_pos;
+};
+
+struct cdev {
+    dev_t dev;
+};
+
+struct dentry;
+
+/*          TRACING                */
+
+#define trace_aesd_read_enter(...) do { } while (0)
+#define trace_aesd_read_exit(...) do { } while (0)
+#define trace_aesd_write_enter(...) do { } while (0)
+#define trace_aesd_write_exit(...) do { } while (0)
+#define trace_aesd_ioctl_enter(...) do { } while (0)
+#define trace_aesd_ioctl_exit(...) do { } while (0)
+#define trace_aesd_llseek_enter(...) do { } while (0)
+#define trace_aesd_llseek_exit(...) do { } while (0)
+#define trace_aesd_entry_commit(...) do { } while (0)
+#define trace_aesd_entry_evict(...) do { } while (0)
+#define trace_aesd_lock_acquired(...) do { } while (0)
+
+#endif /* AESD_CHAR_DRIVER_AESD_COMPAT_H_ */
@@ -0,0 +1,822 @@
+/**
+ * @file aesd-core.c
+ * @brief Read, write, seek and ioctl logic of the AESD char driver
+ *
+ * Everything here works on struct aesd_dev and struct aesd_file only, so main.c can wrap it in
+ * file operations and the userspace harness can build it against aesd-compat.h.
+ *
+ */
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/string.h>
+#include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/uaccess.h>
+#include <linux/fs.h>
+#include <linux/sched.h>
+#include <linux/pid.h>
+#include <linux/log2.h>
+#include <linux/version.h>
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 1, 0)
+/* Sizes of the power of two kmalloc caches, ignoring the 96 and 192 byte ones */
+#define kmalloc_size_roundup(size) roundup_pow_of_two(size)
+#endif
+#else
+#include "aesd-compat.h"
+#endif
+
+#include "aesdchar.h"
+#include "aesd-stats.h"
+#include "aesd-core.h"
+#include "aesd_ioctl.h"
+
+/*          SETUP & TEARDOWN       */
+
+void aesd_dev_init(struct aesd_dev *dev)
+{
+    mutex_init(&dev->lock);
+    init_waitqueue_head(&dev->read_queue);
+    init_waitqueue_head(&dev->write_queue);
+    aesd_circular_buffer_init(&dev->buffer);
+}
+
+/**
+ * Free the entries and the orphaned partial line held by @param dev
+ */
+void aesd_dev_free_entries(struct aesd_dev *dev)
+{
+    uint8_t index;
+    struct aesd_buffer_entry *entry;
+
+    PDEBUG("Freeing temp buffer\n");
+    if(dev->orphan.entry.buffptr != NULL) {
+        kfree(dev->orphan.entry.buffptr);
+    }
+    put_pid(dev->orphan_owner);
+
+    PDEBUG("Freeing main buffer\n");
+    AESD_CIRCULAR_BUFFER_FOREACH(entry, &dev->buffer, index) {
+        if (entry->buffptr != NULL) {
+            kfree(entry->buffptr);
+        }
+    }
+}
+
+void aesd_file_init(struct aesd_file *file, struct aesd_dev *dev)
+{
+    file->dev = dev;
+    file->owner = get_pid(task_tgid(current));
+    mutex_init(&file->lock);
+}
+
+/**
+ * @return true if an entry can be added to @param dev under aesd_full_policy without losing unread data
+ */
+bool aesd_ring_has_room(struct aesd_dev *dev)
+{
+    return !dev->buffer.full || aesd_full_policy == AESD_FULL_OVERWRITE ||
+            dev->consumed_offset >= dev->base_offset + dev->buffer.entry[dev->buffer.out_offs].size;
+}
+
+/**
+ * Record that the data of @param dev up to absolute offset @param offset was returned to a reader,
+ * waking writers waiting for room.  Caller must hold dev->lock.
+ */
+void aesd_mark_consumed(struct aesd_dev *dev, u64 offset)
+{
+    if (offset > dev->consumed_offset) {
+        dev->consumed_offset = offset;
+        wake_up_interruptible(&dev->write_queue);
+    }
+}
+
+/**
+ * Make room for @param count more bytes after the data in @param pending, a partial line of @param dev.
+ * The allocation grows geometrically, so a line accumulated over many small
+ * writes costs amortized linear time instead of a realloc and copy per write.
+ * @return 0 on success, -ENOMEM if the allocation could not be grown.
+ */
+static int aesd_pending_reserve(struct aesd_dev *dev, struct aesd_pending *pending, size_t count)
+{
+    size_t needed = pending->entry.size + count;
+    size_t capacity;
+    char *buffptr;
+
+    if (needed <= pending->capacity) {
+        return 0;
+    }
+
+    capacity = pending->capacity ? pending->capacity : AESD_MIN_ENTRY_CAPACITY;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+
+    buffptr = krealloc(pending->entry.buffptr, capacity, GFP_KERNEL_ACCOUNT);
+    if (!buffptr) {
+        return -ENOMEM;
+    }
+
+    atomic_long_add(capacity - pending->capacity, &dev->pending_bytes);
+    pending->entry.buffptr = buffptr;
+    pending->capacity = capacity;
+    return 0;
+}
+
+/**
+ * Release the state of @param file, which the caller frees
+ */
+void aesd_file_release(struct aesd_file *file)
+{
+    struct aesd_dev *dev = file->dev;
+    struct aesd_pending *pending = &file->pending;
+
+    /**
+     * Hand an unterminated line to the device so the next file of the same process continues
+     * it, which keeps sequences like echo -n "wr" followed by echo "ite" from one shell
+     * producing a single entry.  Lines of different processes are never joined: a line
+     * orphaned by another process is replaced, and counted as dropped.
+     */
+    if (pending->entry.size > 0) {
+        aesd_lock(dev);
+        if (dev->orphan.entry.size == 0 || dev->orphan_owner != file->owner) {
+            if (dev->orphan.entry.size > 0) {
+                PDEBUG("dropping %zu orphaned bytes of another process", dev->orphan.entry.size);
+                AESD_STAT_ADD(dev, AESD_STAT_ORPHAN_DROPPED_BYTES, dev->orphan.entry.size);
+            }
+            atomic_long_sub(dev->orphan.capacity, &dev->pending_bytes);
+            kfree(dev->orphan.entry.buffptr);
+            put_pid(dev->orphan_owner);
+            dev->orphan = *pending;
+            dev->orphan_owner = get_pid(file->owner);
+            memset(pending, 0, sizeof(*pending));
+        } else if (aesd_pending_reserve(dev, &dev->orphan, pending->entry.size) == 0) {
+            memcpy((char *)dev->orphan.entry.buffptr + dev->orphan.entry.size, pending->entry.buffptr,
+                    pending->entry.size);
+            dev->orphan.entry.size += pending->entry.size;
+        } else {
+            PDEBUG("dropping %zu bytes which could not be added to the orphaned line",
+                    pending->entry.size);
+            AESD_STAT_ADD(dev, AESD_STAT_ORPHAN_DROPPED_BYTES, pending->entry.size);
+        }
+        aesd_unlock(dev);
+    }
+
+    atomic_long_sub(pending->capacity, &dev->pending_bytes);
+    kfree(pending->entry.buffptr);
+    put_pid(file->owner);
+}
+
+/*          READ & WRITE          */
+
+/**
+ * @return the position a read of @param file at @param f_pos continues from.  When the last read
+ * found no data at f_pos, this is the ring position of the same absolute offset, which moves back
+ * as entries are evicted.  Caller must hold dev->lock.
+ */
+loff_t aesd_file_resume_pos(struct aesd_file *file, loff_t f_pos)
+{
+    struct aesd_dev *dev = file->dev;
+
+    if (!file->at_eof || f_pos != file->eof_fpos) {
+        return f_pos;
+    }
+    return file->eof_offset > dev->base_offset ? file->eof_offset - dev->base_offset : 0;
+}
+
+/**
+ * Copy up to @param len bytes found at position @param pos of @param dev into a buffer allocated
+ * here and returned in @param bounce, crossing entry boundaries.  Readers copy the bounce buffer to
+ * user space once dev->lock is dropped: copy_to_user() may fault and take mmap_lock, which
+ * aesd_mmap holds while it takes dev->lock.  Caller must hold dev->lock and kvfree *bounce.
+ * @return the number of bytes copied, or -ENOMEM.
+ */
+static ssize_t aesd_gather_range(struct aesd_dev *dev, size_t pos, size_t len, char **bounce)
+{
+    struct aesd_buffer_entry *entry;
+    size_t entry_offset_byte;
+    size_t chunk;
+    size_t copied = 0;
+
+    *bounce = NULL;
+    if (pos >= dev->size) {
+        return 0;
+    }
+    len = min(len, dev->size - pos);
+    if (len == 0) {
+        return 0;
+    }
+    *bounce = kvmalloc(len, GFP_KERNEL);
+    if (*bounce == NULL) {
+        return -ENOMEM;
+    }
+
+    while (copied < len &&
+            (entry = aesd_circular_buffer_find_entry_offset_for_fpos(&dev->buffer, pos + copied,
+                    &entry_offset_byte)) != NULL) {
+        chunk = min(len - copied, entry->size - entry_offset_byte);
+        memcpy(*bounce + copied, entry->buffptr + entry_offset_byte, chunk);
+        copied += chunk;
+    }
+
+    return copied;
+}
+
+ssize_t aesd_do_read(struct file *filp, char __user *buf, size_t count,
+                loff_t *f_pos)
+{
+    size_t entry_offset_byte = 0;
+    size_t bytes_to_copy = 0;
+    char *bounce;
+    
+    struct aesd_file *file = (struct aesd_file *)filp->private_data;
+    struct aesd_dev *dev = file->dev;
+    struct aesd_buffer_entry *entry;
+    u64 generation;
+    
+    ssize_t retval = 0;
+    
+    PDEBUG("read %zu bytes with offset %lld", count, *f_pos);
+    /**
+     * TODO: handle read
+     */
+    if (aesd_lock_interruptible(dev)) {
+        return -ERESTARTSYS;
+    }
+
+    *f_pos = aesd_file_resume_pos(file, *f_pos);
+    while ((entry = aesd_circular_buffer_find_entry_offset_for_fpos(&dev->buffer, *f_pos, &entry_offset_byte)) == NULL) {
+        /**
+         * Once the ring is full, new entries evict as many bytes as they add and size no longer
+         * grows past f_pos.  Remember the absolute offset instead, and wait for any change.
+         */
+        file->at_eof = true;
+        file->eof_fpos = *f_pos;
+        file->eof_offset = dev->base_offset + min_t(u64, *f_pos, dev->size);
+        generation = dev->generation;
+        aesd_unlock(dev);
+
+        if (!aesd_blocking_reads) {
+            return 0;
+        }
+        if (filp->f_flags & O_NONBLOCK) {
+            return -EAGAIN;
+        }
+
+        PDEBUG("read waiting for data at offset %lld", *f_pos);
+        if (wait_event_interruptible(dev->read_queue, READ_ONCE(dev->generation) != generation)) {
+            return -ERESTARTSYS;
+        }
+        if (aesd_lock_interruptible(dev)) {
+            return -ERESTARTSYS;
+        }
+        *f_pos = aesd_file_resume_pos(file, *f_pos);
+    }
+    file->at_eof = false;
+
+    bytes_to_copy = min(count, entry->size - entry_offset_byte);
+    retval = aesd_gather_range(dev, *f_pos, bytes_to_copy, &bounce);
+    if (retval > 0) {
+        aesd_mark_consumed(dev, dev->base_offset + *f_pos + retval);
+        AESD_STAT_INC(dev, AESD_STAT_READS);
+        AESD_STAT_ADD(dev, AESD_STAT_BYTES_READ, retval);
+    }
+    aesd_unlock(dev);
+
+    PDEBUG("Sending %zd bytes to user", retval);
+    if (retval > 0) {
+        if (copy_to_user(buf, bounce, retval)) {
+            retval = -EFAULT;
+        } else {
+            *f_pos += retval;
+        }
+    }
+    kvfree(bounce);
+    return retval;
+}
+
+/**
+ * Add @param entry to the ring of @param dev.  Ownership of entry->buffptr moves to the ring.
+ * Caller must hold dev->lock.
+ */
+static void aesd_commit_entry(struct aesd_dev *dev, const struct aesd_buffer_entry *entry)
+{
+    if (dev->buffer.full) {
+        trace_aesd_entry_evict(dev);
+        dev->size -= dev->buffer.entry[dev->buffer.in_offs].size;
+        dev->base_offset += dev->buffer.entry[dev->buffer.in_offs].size;
+        dev->first_seq++;
+        AESD_STAT_INC(dev, AESD_STAT_EVICTIONS);
+    }
+    kfree(aesd_circular_buffer_add_entry(&dev->buffer, entry));
+    dev->size += entry->size;
+    dev->generation++;
+    trace_aesd_entry_commit(dev, dev->first_seq + aesd_circular_buffer_count(&dev->buffer) - 1, entry->size);
+
+    wake_up_interruptible(&dev->read_queue);
+}
+
+/**
+ * Apply aesd_full_policy before an entry is added to @param dev.  Called and returns with dev->lock
+ * held, which is dropped while waiting for readers.
+ * @return 0 when an entry may be added, -EAGAIN or -ERESTARTSYS otherwise.
+ */
+static int aesd_wait_for_room(struct file *filp, struct aesd_dev *dev)
+{
+    while (!aesd_ring_has_room(dev)) {
+        if (READ_ONCE(aesd_full_policy) == AESD_FULL_FAIL || (filp->f_flags & O_NONBLOCK)) {
+            return -EAGAIN;
+        }
+
+        aesd_unlock(dev);
+        PDEBUG("write waiting for the oldest entry to be read");
+        if (wait_event_interruptible(dev->write_queue,
+                aesd_ring_has_room(dev) || READ_ONCE(aesd_full_policy) != AESD_FULL_BLOCK)) {
+            aesd_lock(dev);
+            return -ERESTARTSYS;
+        }
+        aesd_lock(dev);
+    }
+    return 0;
+}
+
+/**
+ * Free the allocations of the @param nr entries at @param lines, except @param keep, the pending
+ * allocation a line may still be held in
+ */
+static void aesd_free_lines(const struct aesd_buffer_entry *lines, size_t nr, const char *keep)
+{
+    size_t i;
+
+    for (i = 0; i < nr; i++) {
+        if (lines[i].buffptr != keep) {
+            kfree(lines[i].buffptr);
+        }
+    }
+}
+
+/**
+ * Set up the @param nr_lines lines of @param pending, which end at the newlines from @param newline
+ * on, as ring entries in @param lines before dev->lock is taken.  When @param in_place, the first
+ * line keeps the pending allocation and the partial line from @param partial on moves to
+ * @param tail; otherwise the first line gets its own allocation and the partial line stays where it
+ * is.  Every other line is copied once, into an allocation of exactly its size.
+ * @return the number of lines set up, fewer than @param nr_lines if an allocation failed.
+ */
+static size_t aesd_prepare_lines(struct aesd_dev *dev, struct aesd_pending *pending, const char *newline,
+        const char *partial, bool in_place, struct aesd_buffer_entry *lines, size_t nr_lines,
+        struct aesd_pending *tail)
+{
+    const char *start = pending->entry.buffptr;
+    const char *end = start + pending->entry.size;
+    const char *record = start;
+    char *buffptr;
+    size_t i;
+
+    if (in_place && end > partial) {
+        if (aesd_pending_reserve(dev, tail, end - partial)) {
+            return 0;
+        }
+        memcpy((char *)tail->entry.buffptr, partial, end - partial);
+        tail->entry.size = end - partial;
+    }
+
+    for (i = 0; i < nr_lines; i++) {
+        lines[i].size = newline + 1 - record;
+        if (i == 0 && in_place) {
+            lines[i].buffptr = start;
+        } else {
+            buffptr = kmalloc(lines[i].size, GFP_KERNEL_ACCOUNT);
+            if (!buffptr) {
+                break;
+            }
+            memcpy(buffptr, record, lines[i].size);
+            lines[i].buffptr = buffptr;
+        }
+        record = newline + 1;
+        newline = memchr(record, '\n', end - record);
+    }
+    return i;
+}
+
+ssize_t aesd_do_write(struct file *filp, const char __user *buf, size_t count,
+                loff_t *f_pos)
+{
+    struct aesd_file *file = (struct aesd_file *)filp->private_data;
+    struct aesd_dev *dev = file->dev;
+    struct aesd_pending *pending = &file->pending;
+    struct aesd_pending tail;
+    struct aesd_buffer_entry one_line;
+    struct aesd_buffer_entry *lines = &one_line;
+    char *start;
+    char *end;
+    char *partial;
+    char *scan;
+    char *newline;
+    size_t prev_size;
+    size_t nr_lines = 0;
+    size_t prepared;
+    size_t committed = 0;
+    size_t committed_bytes = 0;
+    bool in_place;
+    ssize_t retval = -ENOMEM;
+    
+    PDEBUG("write %zu bytes with offset %lld", count, *f_pos);
+
+    if (count == 0) {
+        return 0;
+    }
+    
+    if (mutex_lock_interruptible(&file->lock)) {
+        return -ERESTARTSYS;
+    }
+
+    if (!file->has_written) {
+        if (aesd_lock_interruptible(dev)) {
+            retval = -ERESTARTSYS;
+            goto exit;
+        }
+        if (dev->orphan.entry.size > 0 && dev->orphan_owner == file->owner) {
+            *pending = dev->orphan;
+            memset(&dev->orphan, 0, sizeof(dev->orphan));
+            put_pid(dev->orphan_owner);
+            dev->orphan_owner = NULL;
+        }
+        aesd_unlock(dev);
+        file->has_written = true;
+    }
+    
+    /**
+     * Copy straight from user space into the pending entry, which becomes
+     * the ring entry once a newline arrives.  Partial lines belong to this
+     * file alone, so the device lock is only needed to commit.
+     */
+    retval = aesd_pending_reserve(dev, pending, count);
+    if (retval) {
+        goto exit;
+    }
+
+    prev_size = pending->entry.size;
+    start = (char *)pending->entry.buffptr;
+    end = start + prev_size + count;
+    if (copy_from_user(start + prev_size, buf, count)) {
+        retval = -EFAULT;
+        goto exit;
+    }
+
+    AESD_STAT_INC(dev, AESD_STAT_WRITES);
+    AESD_STAT_ADD(dev, AESD_STAT_BYTES_WRITTEN, count);
+
+    newline = memchr(start + prev_size, '\n', count);
+    if (newline == NULL) {
+        pending->entry.size += count;
+        AESD_STAT_ADD(dev, AESD_STAT_PARTIAL_BYTES, count);
+        retval = count;
+        goto exit;
+    }
+
+    /**
+     * Every newline terminates an entry, and all but one of the lines and the partial line after
+     * them have to be copied out of the pending allocation.  The first line is committed in place
+     * and the partial line moves to a new allocation when the line is at least as long as the
+     * partial line and the pending allocation is no larger than the kmalloc bucket an exact copy
+     * would get, so committed entries keep no slack from geometric growth; a single line ending
+     * the data usually fits.  Otherwise the first line is copied like the later ones and the
+     * partial line stays pending.  The copies and allocations are all made before dev->lock is
+     * taken.
+     */
+    partial = newline + 1;
+    for (scan = newline; scan != NULL; scan = memchr(partial, '\n', end - partial)) {
+        nr_lines++;
+        partial = scan + 1;
+    }
+    in_place = newline + 1 - start >= end - partial &&
+            kmalloc_size_roundup(newline + 1 - start) >= pending->capacity;
+
+    if (nr_lines > 1) {
+        lines = kvmalloc_array(nr_lines, sizeof(*lines), GFP_KERNEL);
+        if (!lines) {
+            retval = -ENOMEM;
+            goto exit;
+        }
+    }
+
+    memset(&tail, 0, sizeof(tail));
+    pending->entry.size = end - start;
+    prepared = aesd_prepare_lines(dev, pending, newline, partial, in_place, lines, nr_lines, &tail);
+    pending->entry.size = prev_size;
+    if (prepared == 0) {
+        retval = -ENOMEM;
+        goto exit_free;
+    }
+
+    if (aesd_lock_interruptible(dev)) {
+        retval = -ERESTARTSYS;
+        goto exit_free;
+    }
+
+    for (committed = 0; committed < prepared; committed++) {
+        retval = aesd_wait_for_room(filp, dev);
+        if (retval) {
+            break;
+        }
+        aesd_commit_entry(dev, &lines[committed]);
+        committed_bytes += lines[committed].size;
+        if (committed == 0 && in_place) {
+            atomic_long_sub(pending->capacity, &dev->pending_bytes);
+            *pending = tail;
+            memset(&tail, 0, sizeof(tail));
+        }
+    }
+    aesd_unlock(dev);
+
+    if (committed == nr_lines) {
+        if (!in_place) {
+            pending->entry.size = end - partial;
+            memmove(start, partial, pending->entry.size);
+        }
+        AESD_STAT_ADD(dev, AESD_STAT_PARTIAL_BYTES, pending->entry.size);
+        retval = count;
+    } else if (committed > 0) {
+        /**
+         * Keep the lines already committed, drop the rest of this write and report a short count
+         */
+        pending->entry.size = 0;
+        retval = committed_bytes - prev_size;
+    }
+
+exit_free:
+    aesd_free_lines(lines + committed, prepared - committed, pending->entry.buffptr);
+    atomic_long_sub(tail.capacity, &dev->pending_bytes);
+    kfree(tail.entry.buffptr);
+    if (lines != &one_line) {
+        kvfree(lines);
+    }
+exit:
+    mutex_unlock(&file->lock);
+    return retval;
+}
+
+/*          IOCTL & SEEK           */
+
+/**
+ * Move the file position to byte write_cmd_offset of the zero referenced entry write_cmd,
+ * counting from the oldest entry
+ */
+static long aesd_ioctl_seekto(struct file *filp, struct aesd_dev *dev, unsigned long arg)
+{
+    struct aesd_seekto seek_cmd;
+    loff_t pos = 0;
+    uint32_t i;
+    long retval = -EINVAL;
+
+    if (copy_from_user(&seek_cmd, (const void __user *)arg, sizeof(struct aesd_seekto))) {
+        return -EFAULT;
+    }
+
+    PDEBUG("data from userspace: %u, %u", seek_cmd.write_cmd, seek_cmd.write_cmd_offset);
+
+    if (aesd_lock_interruptible(dev)) {
+        return -ERESTARTSYS;
+    }
+
+    if (seek_cmd.write_cmd < aesd_circular_buffer_count(&dev->buffer)) {
+        for (i = 0; i < seek_cmd.write_cmd; i++) {
+            pos += aesd_entry_at(&dev->buffer, i)->size;
+        }
+        if (seek_cmd.write_cmd_offset < aesd_entry_at(&dev->buffer, seek_cmd.write_cmd)->size) {
+            filp->f_pos = pos + seek_cmd.write_cmd_offset;
+            PDEBUG("f_pos:%lld", filp->f_pos);
+            retval = 0;
+        }
+    }
+
+    aesd_unlock(dev);
+    return retval;
+}
+
+/**
+ * Copy the generation and the absolute offset and size of every entry to user space
+ */
+static long aesd_ioctl_entries(struct aesd_dev *dev, unsigned long arg)
+{
+    struct aesd_entry_table table;
+    u64 offset;
+    uint8_t i;
+
+    memset(&table, 0, sizeof(table));
+
+    if (aesd_lock_interruptible(dev)) {
+        return -ERESTARTSYS;
+    }
+
+    table.generation = dev->generation;
+    table.base_offset = dev->base_offset;
+    table.count = aesd_circular_buffer_count(&dev->buffer);
+    offset = dev->base_offset;
+    for (i = 0; i < table.count; i++) {
+        table.entries[i].seq = dev->first_seq + i;
+        table.entries[i].offset = offset;
+        table.entries[i].size = aesd_entry_at(&dev->buffer, i)->size;
+        offset += table.entries[i].size;
+    }
+
+    aesd_unlock(dev);
+
+    if (copy_to_user((void __user *)arg, &table, sizeof(table))) {
+        return -EFAULT;
+    }
+    return 0;
+}
+
+/**
+ * Copy the data found at byte write_cmd_offset of entry write_cmd to user space, leaving
+ * the file position untouched.  The position is validated like AESDCHAR_IOCSEEKTO does, the
+ * data copied from it may run on into the following entries.
+ * @return the number of bytes copied, or -EINVAL for a position outside the entries
+ */
+static long aesd_ioctl_readat(struct aesd_dev *dev, unsigned long arg)
+{
+    struct aesd_readat readat;
+    size_t pos = 0;
+    uint32_t i;
+    char *bounce = NULL;
+    long retval = -EINVAL;
+
+    if (copy_from_user(&readat, (const void __user *)arg, sizeof(struct aesd_readat))) {
+        return -EFAULT;
+    }
+
+    PDEBUG("read at %u, %u for %llu bytes", readat.write_cmd, readat.write_cmd_offset, readat.len);
+
+    if (aesd_lock_interruptible(dev)) {
+        return -ERESTARTSYS;
+    }
+
+    if (readat.write_cmd < aesd_circular_buffer_count(&dev->buffer) &&
+            readat.write_cmd_offset < aesd_entry_at(&dev->buffer, readat.write_cmd)->size) {
+        for (i = 0; i < readat.write_cmd; i++) {
+            pos += aesd_entry_at(&dev->buffer, i)->size;
+        }
+        retval = aesd_gather_range(dev, pos + readat.write_cmd_offset,
+                min_t(u64, readat.len, MAX_RW_COUNT), &bounce);
+        if (retval > 0) {
+            aesd_mark_consumed(dev, dev->base_offset + pos + readat.write_cmd_offset + retval);
+            AESD_STAT_INC(dev, AESD_STAT_READS);
+            AESD_STAT_ADD(dev, AESD_STAT_BYTES_READ, retval);
+        }
+    }
+
+    aesd_unlock(dev);
+
+    if (retval > 0 && copy_to_user(u64_to_user_ptr(readat.buf), bounce, retval)) {
+        retval = -EFAULT;
+    }
+    kvfree(bounce);
+    return retval;
+}
+
+/**
+ * Copy the data found at an absolute cursor to user space.  A cursor pointing at overwritten data
+ * resumes from the oldest entry and reports the bytes skipped; a cursor at the end of the data waits
+ * for a new entry when aesd_blocking_reads is set, like aesd_read.
+ * @return the number of bytes copied
+ */
+static long aesd_ioctl_tail_read(struct file *filp, struct aesd_dev *dev, unsigned long arg)
+{
+    struct aesd_tail_read tail;
+    char *bounce = NULL;
+    ssize_t retval;
+
+    if (copy_from_user(&tail, (const void __user *)arg, sizeof(struct aesd_tail_read))) {
+        return -EFAULT;
+    }
+
+    PDEBUG("tail read at %llu for %llu bytes", tail.cursor, tail.len);
+
+    if (aesd_lock_interruptible(dev)) {
+        return -ERESTARTSYS;
+    }
+
+    while (tail.cursor == dev->base_offset + dev->size) {
+        aesd_unlock(dev);
+
+        if (!aesd_blocking_reads) {
+            tail.skipped = 0;
+            retval = 0;
+            goto exit_copy;
+        }
+        if (filp->f_flags & O_NONBLOCK) {
+            return -EAGAIN;
+        }
+
+        if (wait_event_interruptible(dev->read_queue,
+                READ_ONCE(dev->base_offset) + READ_ONCE(dev->size) != tail.cursor)) {
+            return -ERESTARTSYS;
+        }
+        if (aesd_lock_interruptible(dev)) {
+            return -ERESTARTSYS;
+        }
+    }
+
+    if (tail.cursor > dev->base_offset + dev->size) {
+        aesd_unlock(dev);
+        return -EINVAL;
+    }
+
+    tail.skipped = 0;
+    if (tail.cursor < dev->base_offset) {
+        tail.skipped = dev->base_offset - tail.cursor;
+        tail.cursor = dev->base_offset;
+        PDEBUG("tail read lost %llu bytes", tail.skipped);
+    }
+
+    retval = aesd_gather_range(dev, tail.cursor - dev->base_offset, min_t(u64, tail.len, MAX_RW_COUNT),
+            &bounce);
+    if (retval < 0) {
+        aesd_unlock(dev);
+        return retval;
+    }
+    tail.cursor += retval;
+    aesd_mark_consumed(dev, tail.cursor);
+    AESD_STAT_INC(dev, AESD_STAT_READS);
+    AESD_STAT_ADD(dev, AESD_STAT_BYTES_READ, retval);
+    aesd_unlock(dev);
+
+    if (retval > 0 && copy_to_user(u64_to_user_ptr(tail.buf), bounce, retval)) {
+        kvfree(bounce);
+        return -EFAULT;
+    }
+    kvfree(bounce);
+
+exit_copy:
+    if (copy_to_user((void __user *)arg, &tail, sizeof(struct aesd_tail_read))) {
+        return -EFAULT;
+    }
+    return retval;
+}
+
+long aesd_do_ioctl(struct file *filp, struct aesd_dev *dev, unsigned int cmd, unsigned long arg) {
+    if (_IOC_TYPE(cmd) != AESD_IOC_MAGIC || _IOC_NR(cmd) > AESDCHAR_IOC_MAXNR) {
+        PDEBUG("Command is not valid: %u", cmd);
+        return -ENOTTY;
+    }
+
+    switch (cmd) {
+        case AESDCHAR_IOCSEEKTO:
+            PDEBUG("Recived seek-to command");
+            return aesd_ioctl_seekto(filp, dev, arg);
+
+        case AESDCHAR_IOCENTRIES:
+            return aesd_ioctl_entries(dev, arg);
+
+        case AESDCHAR_IOCREADAT:
+            return aesd_ioctl_readat(dev, arg);
+
+        case AESDCHAR_IOCTAILREAD:
+            return aesd_ioctl_tail_read(filp, dev, arg);
+
+        default:
+            PDEBUG("Command is not valid: %u", cmd);
+            return -ENOTTY;
+    }
+}
+
+loff_t aesd_do_llseek(struct file *filp, struct aesd_dev *dev, loff_t offset, int whence) {
+    loff_t total_size;
+    loff_t newpos;
+
+    // Get bufffer current size
+    if (aesd_lock_interruptible(dev)) {
+        return -ERESTARTSYS;
+    }
+    total_size = dev->size;
+    aesd_unlock(dev);
+
+    switch (whence) {
+        case SEEK_SET:
+            newpos = offset;
+            break;
+
+        case SEEK_CUR:
+            newpos = filp->f_pos + offset;
+            break;
+
+        case SEEK_END:
+            newpos = total_size + offset;
+            break;
+
+        default:
+            return -EINVAL;
+    }
+
+    if (newpos < 0 || newpos > total_size) {
+        return -EINVAL;
+    }
+
+    filp->f_pos = newpos;
+    return newpos;
+}
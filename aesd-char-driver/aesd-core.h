@@ -0,0 +1,38 @@
+/*
+ * aesd-core.h
+ *
+ *  @brief Read, write, seek and ioctl logic of the aesdchar driver, independent of the
+ *  character device glue in main.c so it also builds into the userspace harness
+ */
+
+#ifndef AESD_CHAR_DRIVER_AESD_CORE_H_
+#define AESD_CHAR_DRIVER_AESD_CORE_H_
+
+#include "aesdchar.h"
+
+/**
+ * Module parameters, defined in main.c or by the harness
+ */
+extern bool aesd_blocking_reads;
+extern int aesd_full_policy;
+
+static inline struct aesd_dev *aesd_dev_of(struct file *filp)
+{
+    return ((struct aesd_file *)filp->private_data)->dev;
+}
+
+extern void aesd_dev_init(struct aesd_dev *dev);
+extern void aesd_dev_free_entries(struct aesd_dev *dev);
+extern void aesd_file_init(struct aesd_file *file, struct aesd_dev *dev);
+extern void aesd_file_release(struct aesd_file *file);
+
+extern bool aesd_ring_has_room(struct aesd_dev *dev);
+extern void aesd_mark_consumed(struct aesd_dev *dev, u64 offset);
+extern loff_t aesd_file_resume_pos(struct aesd_file *file, loff_t f_pos);
+
+extern ssize_t aesd_do_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos);
+extern ssize_t aesd_do_write(struct file *filp, const char __user *buf, size_t count, loff_t *f_pos);
+extern long aesd_do_ioctl(struct file *filp, struct aesd_dev *dev, unsigned int cmd, unsigned long arg);
+extern loff_t aesd_do_llseek(struct file *filp, struct aesd_dev *dev, loff_t offset, int whence);
+
+#endif /* AESD_CHAR_DRIVER_AESD_CORE_H_ */
@@ -0,0 +1,184 @@
+/**
+ * @file aesd-stats.c
+ * @brief Statistics, lock timing histograms and runtime debug control for the AESD char driver
+ *
+ * Counters are per CPU so the hot paths only pay for a local increment, and are summed
+ * when read from /sys/kernel/debug/aesdchar/aesdchar<N>/.
+ *
+ */
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/jump_label.h>
+#include <linux/slab.h>
+#include <linux/cdev.h>
+#include <linux/wait.h>
+#include <linux/kref.h>
+#include <linux/fs.h>
+
+#include "aesd-stats.h"
+
+/**
+ * Per operation PDEBUG logging, off unless enabled through the aesd_debug parameter
+ */
+DEFINE_STATIC_KEY_FALSE(aesd_debug_key);
+
+static int aesd_debug_set(const char *val, const struct kernel_param *kp)
+{
+    bool enable;
+    int ret = kstrtobool(val, &enable);
+
+    if (ret) {
+        return ret;
+    }
+
+    if (enable) {
+        static_branch_enable(&aesd_debug_key);
+    } else {
+        static_branch_disable(&aesd_debug_key);
+    }
+    return 0;
+}
+
+static int aesd_debug_get(char *buffer, const struct kernel_param *kp)
+{
+    return sprintf(buffer, "%c\n", static_key_enabled(&aesd_debug_key) ? 'Y' : 'N');
+}
+
+static const struct kernel_param_ops aesd_debug_ops = {
+    .set =      aesd_debug_set,
+    .get =      aesd_debug_get,
+};
+
+module_param_cb(aesd_debug, &aesd_debug_ops, NULL, 0644);
+MODULE_PARM_DESC(aesd_debug, "Log every operation with printk, can be toggled at runtime");
+
+static struct dentry *aesd_debugfs_root;
+
+static const char * const aesd_stat_names[AESD_STAT_NR] = {
+    [AESD_STAT_WRITES] =        "writes",
+    [AESD_STAT_READS] =         "reads",
+    [AESD_STAT_BYTES_WRITTEN] = "bytes_written",
+    [AESD_STAT_BYTES_READ] =    "bytes_read",
+    [AESD_STAT_EVICTIONS] =     "evictions",
+    [AESD_STAT_PARTIAL_BYTES] = "partial_write_bytes",
+    [AESD_STAT_IOCTLS] =        "ioctls",
+    [AESD_STAT_RECLAIMED] =     "reclaimed",
+    [AESD_STAT_ORPHAN_DROPPED_BYTES] = "orphan_dropped_bytes",
+};
+
+static void aesd_stats_sum(struct aesd_dev *dev, struct aesd_stats *sum)
+{
+    struct aesd_stats *cpu_stats;
+    int cpu;
+    int i;
+
+    memset(sum, 0, sizeof(*sum));
+    for_each_possible_cpu(cpu) {
+        cpu_stats = per_cpu_ptr(dev->stats, cpu);
+        for (i = 0; i < AESD_STAT_NR; i++) {
+            sum->count[i] += cpu_stats->count[i];
+        }
+        for (i = 0; i < AESD_LOCK_HIST_BUCKETS; i++) {
+            sum->lock_wait[i] += cpu_stats->lock_wait[i];
+            sum->lock_hold[i] += cpu_stats->lock_hold[i];
+        }
+    }
+}
+
+static int aesd_stats_show(struct seq_file *s, void *unused)
+{
+    struct aesd_dev *dev = s->private;
+    struct aesd_stats *sum;
+    size_t ring_bytes;
+    size_t snapshot_bytes;
+    uint8_t entries;
+    int i;
+
+    sum = kmalloc(sizeof(*sum), GFP_KERNEL);
+    if (!sum) {
+        return -ENOMEM;
+    }
+    aesd_stats_sum(dev, sum);
+
+    aesd_lock(dev);
+    entries = aesd_circular_buffer_count(&dev->buffer);
+    ring_bytes = dev->size;
+    snapshot_bytes = dev->snapshot ? dev->snapshot->area_size : 0;
+    aesd_unlock(dev);
+
+    for (i = 0; i < AESD_STAT_NR; i++) {
+        seq_printf(s, "%s: %llu\n", aesd_stat_names[i], sum->count[i]);
+    }
+    seq_printf(s, "entries: %u\n", entries);
+    seq_printf(s, "ring_bytes: %zu\n", ring_bytes);
+    seq_printf(s, "pending_bytes: %ld\n", atomic_long_read(&dev->pending_bytes));
+    seq_printf(s, "snapshot_bytes: %zu\n", snapshot_bytes);
+
+    kfree(sum);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(aesd_stats);
+
+static int aesd_lock_hist_show(struct seq_file *s, void *unused)
+{
+    struct aesd_dev *dev = s->private;
+    struct aesd_stats *sum;
+    int i;
+
+    sum = kmalloc(sizeof(*sum), GFP_KERNEL);
+    if (!sum) {
+        return -ENOMEM;
+    }
+    aesd_stats_sum(dev, sum);
+
+    seq_puts(s, "ns_from wait hold\n");
+    for (i = 0; i < AESD_LOCK_HIST_BUCKETS; i++) {
+        if (sum->lock_wait[i] || sum->lock_hold[i]) {
+            seq_printf(s, "%llu %llu %llu\n", i ? 1ULL << i : 0ULL, sum->lock_wait[i], sum->lock_hold[i]);
+        }
+    }
+
+    kfree(sum);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(aesd_lock_hist);
+
+/**
+ * Allocate the counters of @param dev and publish them in debugfs as aesdchar<@param index>
+ * @return 0 on success, -ENOMEM if the counters could not be allocated
+ */
+int aesd_stats_init(struct aesd_dev *dev, int index)
+{
+    char name[16];
+
+    dev->stats = alloc_percpu(struct aesd_stats);
+    if (!dev->stats) {
+        return -ENOMEM;
+    }
+
+    /**
+     * debugfs failures are not fatal, the device works without its statistics files
+     */
+    snprintf(name, sizeof(name), "aesdchar%d", index);
+    dev->debugfs = debugfs_create_dir(name, aesd_debugfs_root);
+    debugfs_create_file("stats", 0444, dev->debugfs, dev, &aesd_stats_fops);
+    debugfs_create_file("lock_hist", 0444, dev->debugfs, dev, &aesd_lock_hist_fops);
+    return 0;
+}
+
+void aesd_stats_cleanup(struct aesd_dev *dev)
+{
+    debugfs_remove_recursive(dev->debugfs);
+    free_percpu(dev->stats);
+}
+
+void aesd_stats_module_init(void)
+{
+    aesd_debugfs_root = debugfs_create_dir("aesdchar", NULL);
+}
+
+void aesd_stats_module_cleanup(void)
+{
+    debugfs_remove_recursive(aesd_debugfs_root);
+}
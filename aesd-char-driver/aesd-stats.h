@@ -0,0 +1,143 @@
+/*
+ * aesd-stats.h
+ *
+ *  @brief Per device counters, lock timing and debugfs export for the aesdchar driver
+ */
+
+#ifndef AESD_CHAR_DRIVER_AESD_STATS_H_
+#define AESD_CHAR_DRIVER_AESD_STATS_H_
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/percpu.h>
+#include <linux/log2.h>
+#include <linux/mutex.h>
+#include <linux/timekeeping.h>
+#else
+#include "aesd-compat.h"
+#endif
+
+#include "aesdchar.h"
+#ifdef __KERNEL__
+#include "aesd-trace.h"
+#endif
+
+/**
+ * Counters kept for each device, see struct aesd_stats
+ */
+enum aesd_stat
+{
+    AESD_STAT_WRITES,
+    AESD_STAT_READS,
+    AESD_STAT_BYTES_WRITTEN,
+    AESD_STAT_BYTES_READ,
+    AESD_STAT_EVICTIONS,
+    /**
+     * Bytes written which were left pending as part of an unterminated line
+     */
+    AESD_STAT_PARTIAL_BYTES,
+    AESD_STAT_IOCTLS,
+    /**
+     * Entries dropped by the shrinker under memory pressure
+     */
+    AESD_STAT_RECLAIMED,
+    /**
+     * Bytes of partial lines discarded when their file was released: a line orphaned by another
+     * process, or one whose continuation could not be allocated.  Also orphaned lines dropped by
+     * the shrinker.
+     */
+    AESD_STAT_ORPHAN_DROPPED_BYTES,
+    AESD_STAT_NR,
+};
+
+/**
+ * Number of log2 nanosecond buckets in the lock histograms, the last one collects everything slower
+ */
+#define AESD_LOCK_HIST_BUCKETS 32
+
+/**
+ * Per CPU statistics of a device, summed when read from debugfs
+ */
+struct aesd_stats
+{
+    u64 count[AESD_STAT_NR];
+    /**
+     * Time spent waiting for dev->lock, bucket i counts waits in [2^i, 2^(i+1)) ns
+     */
+    u64 lock_wait[AESD_LOCK_HIST_BUCKETS];
+    /**
+     * Time dev->lock was held, bucketed like lock_wait
+     */
+    u64 lock_hold[AESD_LOCK_HIST_BUCKETS];
+};
+
+#define AESD_STAT_INC(dev, stat)        this_cpu_inc((dev)->stats->count[stat])
+#define AESD_STAT_ADD(dev, stat, n)     this_cpu_add((dev)->stats->count[stat], (n))
+
+static inline unsigned int aesd_lock_hist_bucket(u64 ns)
+{
+    unsigned int bucket = ilog2(ns | 1);
+
+    return min_t(unsigned int, bucket, AESD_LOCK_HIST_BUCKETS - 1);
+}
+
+/**
+ * Take dev->lock, recording how long the caller waited for it
+ * @return 0 on success, -EINTR if interrupted by a signal
+ */
+static inline int aesd_lock_interruptible(struct aesd_dev *dev)
+{
+    u64 start = ktime_get_ns();
+
+    if (mutex_lock_interruptible(&dev->lock)) {
+        return -EINTR;
+    }
+    dev->lock_acquired_ns = ktime_get_ns();
+    this_cpu_inc(dev->stats->lock_wait[aesd_lock_hist_bucket(dev->lock_acquired_ns - start)]);
+    trace_aesd_lock_acquired(dev, dev->lock_acquired_ns - start);
+    return 0;
+}
+
+/**
+ * Take dev->lock uninterruptibly, recording how long the caller waited for it
+ */
+static inline void aesd_lock(struct aesd_dev *dev)
+{
+    u64 start = ktime_get_ns();
+
+    mutex_lock(&dev->lock);
+    dev->lock_acquired_ns = ktime_get_ns();
+    this_cpu_inc(dev->stats->lock_wait[aesd_lock_hist_bucket(dev->lock_acquired_ns - start)]);
+    trace_aesd_lock_acquired(dev, dev->lock_acquired_ns - start);
+}
+
+/**
+ * Take dev->lock only if it is free, for callers such as reclaim which must not wait
+ * @return true if the lock was taken
+ */
+static inline bool aesd_trylock(struct aesd_dev *dev)
+{
+    if (!mutex_trylock(&dev->lock)) {
+        return false;
+    }
+    dev->lock_acquired_ns = ktime_get_ns();
+    return true;
+}
+
+/**
+ * Release dev->lock, recording how long it was held
+ */
+static inline void aesd_unlock(struct aesd_dev *dev)
+{
+    u64 held = ktime_get_ns() - dev->lock_acquired_ns;
+
+    mutex_unlock(&dev->lock);
+    this_cpu_inc(dev->stats->lock_hold[aesd_lock_hist_bucket(held)]);
+}
+
+extern int aesd_stats_init(struct aesd_dev *dev, int index);
+extern void aesd_stats_cleanup(struct aesd_dev *dev);
+extern void aesd_stats_module_init(void);
+extern void aesd_stats_module_cleanup(void);
+
+#endif /* AESD_CHAR_DRIVER_AESD_STATS_H_ */
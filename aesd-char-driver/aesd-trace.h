@@ -0,0 +1,205 @@
+/*
+ * aesd-trace.h
+ *
+ *  @brief Trace events of the aesdchar driver, found under events/aesdchar in tracefs
+ *
+ *  Every file operation reports entry and exit so the time between them can be split into
+ *  lock waits (aesd_lock_acquired) and the copy itself.  Devices are identified by minor.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM aesdchar
+
+#if !defined(_AESD_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _AESD_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/kdev_t.h>
+#include <linux/ioctl.h>
+#include <linux/cdev.h>
+
+#include "aesdchar.h"
+
+DECLARE_EVENT_CLASS(aesd_io_enter,
+    TP_PROTO(struct aesd_dev *dev, size_t count, loff_t pos),
+    TP_ARGS(dev, count, pos),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(size_t, count)
+        __field(loff_t, pos)
+    ),
+    TP_fast_assign(
+        __entry->minor = MINOR(dev->cdev.dev);
+        __entry->count = count;
+        __entry->pos = pos;
+    ),
+    TP_printk("minor=%u count=%zu pos=%lld", __entry->minor, __entry->count, __entry->pos)
+);
+
+DEFINE_EVENT(aesd_io_enter, aesd_read_enter,
+    TP_PROTO(struct aesd_dev *dev, size_t count, loff_t pos),
+    TP_ARGS(dev, count, pos)
+);
+
+DEFINE_EVENT(aesd_io_enter, aesd_write_enter,
+    TP_PROTO(struct aesd_dev *dev, size_t count, loff_t pos),
+    TP_ARGS(dev, count, pos)
+);
+
+DECLARE_EVENT_CLASS(aesd_io_exit,
+    TP_PROTO(struct aesd_dev *dev, ssize_t ret, loff_t pos),
+    TP_ARGS(dev, ret, pos),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(ssize_t, ret)
+        __field(loff_t, pos)
+    ),
+    TP_fast_assign(
+        __entry->minor = MINOR(dev->cdev.dev);
+        __entry->ret = ret;
+        __entry->pos = pos;
+    ),
+    TP_printk("minor=%u ret=%zd pos=%lld", __entry->minor, __entry->ret, __entry->pos)
+);
+
+DEFINE_EVENT(aesd_io_exit, aesd_read_exit,
+    TP_PROTO(struct aesd_dev *dev, ssize_t ret, loff_t pos),
+    TP_ARGS(dev, ret, pos)
+);
+
+DEFINE_EVENT(aesd_io_exit, aesd_write_exit,
+    TP_PROTO(struct aesd_dev *dev, ssize_t ret, loff_t pos),
+    TP_ARGS(dev, ret, pos)
+);
+
+TRACE_EVENT(aesd_ioctl_enter,
+    TP_PROTO(struct aesd_dev *dev, unsigned int cmd),
+    TP_ARGS(dev, cmd),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(unsigned int, nr)
+    ),
+    TP_fast_assign(
+        __entry->minor = MINOR(dev->cdev.dev);
+        __entry->nr = _IOC_NR(cmd);
+    ),
+    TP_printk("minor=%u nr=%u", __entry->minor, __entry->nr)
+);
+
+TRACE_EVENT(aesd_ioctl_exit,
+    TP_PROTO(struct aesd_dev *dev, unsigned int cmd, long ret),
+    TP_ARGS(dev, cmd, ret),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(unsigned int, nr)
+        __field(long, ret)
+    ),
+    TP_fast_assign(
+        __entry->minor = MINOR(dev->cdev.dev);
+        __entry->nr = _IOC_NR(cmd);
+        __entry->ret = ret;
+    ),
+    TP_printk("minor=%u nr=%u ret=%ld", __entry->minor, __entry->nr, __entry->ret)
+);
+
+TRACE_EVENT(aesd_llseek_enter,
+    TP_PROTO(struct aesd_dev *dev, loff_t offset, int whence),
+    TP_ARGS(dev, offset, whence),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(loff_t, offset)
+        __field(int, whence)
+    ),
+    TP_fast_assign(
+        __entry->minor = MINOR(dev->cdev.dev);
+        __entry->offset = offset;
+        __entry->whence = whence;
+    ),
+    TP_printk("minor=%u offset=%lld whence=%d", __entry->minor, __entry->offset, __entry->whence)
+);
+
+TRACE_EVENT(aesd_llseek_exit,
+    TP_PROTO(struct aesd_dev *dev, loff_t ret),
+    TP_ARGS(dev, ret),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(loff_t, ret)
+    ),
+    TP_fast_assign(
+        __entry->minor = MINOR(dev->cdev.dev);
+        __entry->ret = ret;
+    ),
+    TP_printk("minor=%u ret=%lld", __entry->minor, __entry->ret)
+);
+
+/**
+ * An entry added to the ring at in_offs, out_offs being the oldest entry once it is added
+ */
+TRACE_EVENT(aesd_entry_commit,
+    TP_PROTO(struct aesd_dev *dev, u64 seq, size_t size),
+    TP_ARGS(dev, seq, size),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(u64, seq)
+        __field(size_t, size)
+        __field(u8, in_offs)
+        __field(u8, out_offs)
+    ),
+    TP_fast_assign(
+        __entry->minor = MINOR(dev->cdev.dev);
+        __entry->seq = seq;
+        __entry->size = size;
+        __entry->in_offs = dev->buffer.in_offs;
+        __entry->out_offs = dev->buffer.out_offs;
+    ),
+    TP_printk("minor=%u seq=%llu size=%zu in_offs=%u out_offs=%u", __entry->minor, __entry->seq,
+            __entry->size, __entry->in_offs, __entry->out_offs)
+);
+
+/**
+ * The oldest entry, at ring index out_offs and absolute offset offset, about to be overwritten
+ */
+TRACE_EVENT(aesd_entry_evict,
+    TP_PROTO(struct aesd_dev *dev),
+    TP_ARGS(dev),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(u64, seq)
+        __field(u64, offset)
+        __field(size_t, size)
+        __field(u8, out_offs)
+    ),
+    TP_fast_assign(
+        __entry->minor = MINOR(dev->cdev.dev);
+        __entry->seq = dev->first_seq;
+        __entry->offset = dev->base_offset;
+        __entry->size = dev->buffer.entry[dev->buffer.out_offs].size;
+        __entry->out_offs = dev->buffer.out_offs;
+    ),
+    TP_printk("minor=%u seq=%llu offset=%llu size=%zu out_offs=%u", __entry->minor, __entry->seq,
+            __entry->offset, __entry->size, __entry->out_offs)
+);
+
+TRACE_EVENT(aesd_lock_acquired,
+    TP_PROTO(struct aesd_dev *dev, u64 wait_ns),
+    TP_ARGS(dev, wait_ns),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(u64, wait_ns)
+    ),
+    TP_fast_assign(
+        __entry->minor = MINOR(dev->cdev.dev);
+        __entry->wait_ns = wait_ns;
+    ),
+    TP_printk("minor=%u wait_ns=%llu", __entry->minor, __entry->wait_ns)
+);
+
+#endif /* _AESD_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE aesd-trace
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -38,9 +38,152 @@ struct aesd_seekto {
 
 // Define a write command from the user point of view, use command number 1
 #define AESDCHAR_IOCSEEKTO _IOWR(AESD_IOC_MAGIC, 1, struct aesd_seekto)
+
+/**
+ * Number of entries held by an aesdchar device, matching AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED
+ */
+#define AESDCHAR_MAX_ENTRIES 10
+
+/**
+ * Location of one entry within the data area of an aesdchar mapping
+ */
+struct aesd_mmap_entry {
+    /**
+     * Byte offset of the entry from the start of the data area
+     */
+    uint64_t offset;
+    /**
+     * Number of bytes in the entry
+     */
+    uint64_t size;
+};
+
+/**
+ * Layout of the first page of an mmap of an aesdchar device.  The entries follow at data_offset
+ * bytes from the start of the mapping, concatenated from oldest to newest.  A mapping is a read-only
+ * snapshot of the device; map the header page again to find out whether generation has moved on.
+ */
+struct aesd_mmap_header {
+    /**
+     * Number of changes made to the device when the snapshot was taken
+     */
+    uint64_t generation;
+    /**
+     * Offset of the data area from the start of the mapping
+     */
+    uint64_t data_offset;
+    /**
+     * Number of bytes in the data area
+     */
+    uint64_t data_size;
+    /**
+     * Number of valid elements in entries
+     */
+    uint32_t entry_count;
+    uint32_t reserved;
+    struct aesd_mmap_entry entries[AESDCHAR_MAX_ENTRIES];
+};
+
+/**
+ * Position of one entry in the stream of every byte ever written to the device
+ */
+struct aesd_entry_info {
+    /**
+     * Sequence number of the entry, counting every entry ever written to the device
+     */
+    uint64_t seq;
+    /**
+     * Absolute byte offset of the first byte of the entry
+     */
+    uint64_t offset;
+    /**
+     * Number of bytes in the entry
+     */
+    uint64_t size;
+};
+
+/**
+ * A structure filled by AESDCHAR_IOCENTRIES describing every entry held by the device,
+ * from oldest to newest
+ */
+struct aesd_entry_table {
+    /**
+     * Number of changes made to the device, as in struct aesd_mmap_header
+     */
+    uint64_t generation;
+    /**
+     * Absolute offset of the oldest entry, which is file position 0
+     */
+    uint64_t base_offset;
+    /**
+     * Number of valid elements in entries
+     */
+    uint32_t count;
+    uint32_t reserved;
+    struct aesd_entry_info entries[AESDCHAR_MAX_ENTRIES];
+};
+
+// Read the entry table in a single call, use command number 2
+#define AESDCHAR_IOCENTRIES _IOR(AESD_IOC_MAGIC, 2, struct aesd_entry_table)
+
+/**
+ * A structure passed by AESDCHAR_IOCREADAT to read from a position described like
+ * struct aesd_seekto, without moving the file position
+ */
+struct aesd_readat {
+    /**
+     * The zero referenced write command to start reading from
+     */
+    uint32_t write_cmd;
+    /**
+     * The zero referenced offset from the start of the write, which must be within that write.
+     * The data read may extend into the following writes; continue a partial read with
+     * AESDCHAR_IOCTAILREAD from the absolute offset of the position, see AESDCHAR_IOCENTRIES.
+     */
+    uint32_t write_cmd_offset;
+    /**
+     * User space address of the buffer to fill
+     */
+    uint64_t buf;
+    /**
+     * Size of the buffer at buf
+     */
+    uint64_t len;
+};
+
+// Positional read returning the number of bytes copied, use command number 3
+#define AESDCHAR_IOCREADAT _IOW(AESD_IOC_MAGIC, 3, struct aesd_readat)
+
+/**
+ * A structure passed by AESDCHAR_IOCTAILREAD to stream the device from an absolute cursor,
+ * which stays valid when older entries are overwritten
+ */
+struct aesd_tail_read {
+    /**
+     * Absolute offset to read from, updated to the offset following the data returned
+     */
+    uint64_t cursor;
+    /**
+     * User space address of the buffer to fill
+     */
+    uint64_t buf;
+    /**
+     * Size of the buffer at buf
+     */
+    uint64_t len;
+    /**
+     * Set to the number of bytes between cursor and the oldest data which were overwritten
+     * before they could be read, zero when nothing was lost
+     */
+    uint64_t skipped;
+};
+
+// Read from an absolute cursor reporting lost data, use command number 4
+#define AESDCHAR_IOCTAILREAD _IOWR(AESD_IOC_MAGIC, 4, struct aesd_tail_read)
+
 /**
  * The maximum number of commands supported, used for bounds checking
  */
-#define AESDCHAR_IOC_MAXNR 1
+#define AESDCHAR_IOC_MAXNR 4
 
 #endif /* AESD_IOCTL_H */
@@ -13,8 +13,19 @@
 #undef PDEBUG             /* undef it, just in case */
 #ifdef AESD_DEBUG
 #  ifdef __KERNEL__
-     /* This one if debugging is on, and kernel space */
-#    define PDEBUG(fmt, args...) printk( KERN_DEBUG "aesdchar: " fmt, ## args)
+#    include <linux/jump_label.h>
+     DECLARE_STATIC_KEY_FALSE(aesd_debug_key);
+     /* This one if debugging is on, and kernel space, printing only once enabled with the aesd_debug parameter */
+#    define PDEBUG(fmt, args...) do { \
+        if (static_branch_unlikely(&aesd_debug_key)) \
+            printk( KERN_DEBUG "aesdchar: " fmt, ## args); \
+     } while (0)
+#  elif defined(AESD_CHAR_DRIVER_AESD_COMPAT_H_)
+     /* This one for the userspace harness, printing only once enabled with aesd_debug */
+#    define PDEBUG(fmt, args...) do { \
+        if (aesd_debug) \
+            aesd_debug_printf("aesdchar: " fmt "\n", ## args); \
+     } while (0)
 #  else
      /* This one for user space */
 #    define PDEBUG(fmt, args...) fprintf(stderr, fmt, ## args)
@@ -25,16 +36,176 @@
 
 #include "aesd-circular-buffer.h"
 
+struct aesd_stats;
+
+/**
+ * Default number of aesdchar devices, see the aesd_nr_devs module parameter
+ */
+#define AESD_NR_DEVS 1
+
+/**
+ * What a write does when the ring is full, see the aesd_full_policy module parameter
+ */
+enum aesd_full_policy
+{
+    /**
+     * Overwrite and free the oldest entry
+     */
+    AESD_FULL_OVERWRITE = 0,
+    /**
+     * Fail with -EAGAIN unless readers have consumed the oldest entry
+     */
+    AESD_FULL_FAIL = 1,
+    /**
+     * Block the writer until readers consume the oldest entry
+     */
+    AESD_FULL_BLOCK = 2,
+};
+
+/**
+ * Initial allocation for a pending entry, doubled as the line grows
+ */
+#define AESD_MIN_ENTRY_CAPACITY 64
+
+/**
+ * A read-only copy of the ring contents laid out for mmap, shared by every mapping
+ * taken while the device generation is unchanged
+ */
+struct aesd_snapshot
+{
+    struct kref ref;
+    /**
+     * Device generation the contents were copied from
+     */
+    u64 generation;
+    /**
+     * Device base_offset when the contents were copied
+     */
+    u64 base_offset;
+    /**
+     * Kernel mapping of pages, a struct aesd_mmap_header page followed by the data
+     */
+    void *area;
+    size_t area_size;
+    struct page **pages;
+    unsigned int nr_pages;
+};
+
+/**
+ * A line accumulated across writes until its newline arrives
+ */
+struct aesd_pending
+{
+    struct aesd_buffer_entry entry;
+    /**
+     * Number of bytes allocated at entry.buffptr, which may exceed entry.size
+     */
+    size_t capacity;
+};
+
 struct aesd_dev
 {
     /**
      * TODO: Add structure(s) and locks needed to complete assignment requirements
      */
     struct aesd_circular_buffer buffer;
-    struct aesd_buffer_entry entry;                    
+    /**
+     * Partial line left by a file released before its newline arrived, continued by the next
+     * file opened by the same process, orphan_owner, to write
+     */
+    struct aesd_pending orphan;
+    struct pid *orphan_owner;
+    /**
+     * Total number of bytes held by the entries in buffer
+     */
+    size_t size;
+    /**
+     * Absolute offset of the oldest entry, the number of bytes evicted from buffer so far
+     */
+    u64 base_offset;
+    /**
+     * Sequence number of the oldest entry, the number of entries evicted from buffer so far
+     */
+    u64 first_seq;
+    /**
+     * Highest absolute offset returned to any reader, entries ending before it count as consumed
+     */
+    u64 consumed_offset;
     struct mutex lock;     
+    /**
+     * Time lock was last taken, for the hold time histogram
+     */
+    u64 lock_acquired_ns;
+    /**
+     * Woken each time an entry is added to buffer
+     */
+    wait_queue_head_t read_queue;
+    /**
+     * Woken each time consumed_offset advances, for writers blocked on a full ring
+     */
+    wait_queue_head_t write_queue;
+    /**
+     * Incremented each time the contents of buffer change
+     */
+    u64 generation;
+    /**
+     * Most recent snapshot for mmap, or NULL if none was taken yet
+     */
+    struct aesd_snapshot *snapshot;
+    /**
+     * Bytes allocated for partial lines of open files and orphan
+     */
+    atomic_long_t pending_bytes;
+    /**
+     * Per CPU counters, see aesd-stats.h
+     */
+    struct aesd_stats __percpu *stats;
+    struct dentry *debugfs;
     struct cdev cdev;     /* Char device structure      */
 };
 
+/**
+ * @return the entry at zero referenced position @param index counting from the oldest entry in @param buffer
+ */
+static inline struct aesd_buffer_entry *aesd_entry_at(struct aesd_circular_buffer *buffer, uint8_t index)
+{
+    return &buffer->entry[(buffer->out_offs + index) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+}
+
+/**
+ * Per open file state, stored in filp->private_data
+ */
+struct aesd_file
+{
+    struct aesd_dev *dev;
+    /**
+     * Thread group which opened the file, the only one whose partial lines it continues
+     */
+    struct pid *owner;
+    /**
+     * Serializes writes sharing this open file and its splice state, dev->lock nests inside it
+     */
+    struct mutex lock;
+    struct aesd_pending pending;
+    /**
+     * Set on the first write, after which the file no longer adopts dev->orphan
+     */
+    bool has_written;
+    /**
+     * Where the last read found no data, as the file position eof_fpos and the absolute device
+     * offset eof_offset, protected by dev->lock.  Reading on from eof_fpos follows the bytes
+     * after eof_offset even when evictions have since moved the ring under it.
+     */
+    bool at_eof;
+    loff_t eof_fpos;
+    u64 eof_offset;
+    /**
+     * Referenced snapshot the last splice read from and the position it stopped at.  A splice
+     * continuing from splice_pos reads on from the same snapshot.
+     */
+    struct aesd_snapshot *splice_snapshot;
+    loff_t splice_pos;
+};
+
 
 #endif /* AESD_CHAR_DRIVER_AESDCHAR_H_ */
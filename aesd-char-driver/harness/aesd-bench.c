@@ -0,0 +1,350 @@
+/**
+ * @file aesd-bench.c
+ * @brief Multi-threaded benchmark of the aesdchar driver core, run in userspace through aesd-harness
+ *
+ * Usage: aesd-bench [-m write|read|seek|mixed] [-w writers] [-r readers] [-n ops per thread]
+ *                   [-s line size] [-c chunks per line] [-p full policy] [-d]
+ *
+ * write    writers append lines of -s bytes, each split into -c write calls
+ * read     readers scan the whole device from position 0 with read, over and over
+ * seek     readers seek to a random entry with AESDCHAR_IOCSEEKTO and read from there
+ * mixed    writers append while readers follow them with blocking AESDCHAR_IOCTAILREAD.  Writers
+ *          keep appending past -n lines until every reader has made -n reads, and the readers
+ *          then drain what is left
+ *
+ */
+#include <getopt.h>
+#include <sched.h>
+
+#include "aesd-harness.h"
+
+#define BENCH_READ_SIZE 4096
+
+enum bench_mode
+{
+    BENCH_WRITE,
+    BENCH_READ,
+    BENCH_SEEK,
+    BENCH_MIXED,
+};
+
+struct bench_config
+{
+    enum bench_mode mode;
+    int writers;
+    int readers;
+    long ops;
+    size_t line_size;
+    int chunks;
+};
+
+struct bench_thread
+{
+    pthread_t thread;
+    struct bench_config *config;
+    unsigned int seed;
+    long ops;
+    u64 bytes;
+};
+
+static struct aesd_dev bench_dev;
+static _Atomic bool writers_done;
+static _Atomic int readers_pending;
+
+static const char *bench_mode_names[] = {
+    [BENCH_WRITE] = "write",
+    [BENCH_READ] =  "read",
+    [BENCH_SEEK] =  "seek",
+    [BENCH_MIXED] = "mixed",
+};
+
+/**
+ * Append config->ops lines to the device, each written in config->chunks pieces
+ */
+static void *bench_writer(void *arg)
+{
+    struct bench_thread *t = arg;
+    struct bench_config *config = t->config;
+    struct aesd_harness_file hf;
+    size_t chunk = (config->line_size + config->chunks - 1) / config->chunks;
+    size_t off;
+    size_t len;
+    ssize_t ret;
+    char *line;
+    long i;
+
+    line = malloc(config->line_size);
+    if (!line) {
+        return NULL;
+    }
+    memset(line, 'a' + (t->seed % 26), config->line_size - 1);
+    line[config->line_size - 1] = '\n';
+
+    aesd_harness_open(&hf, &bench_dev, 0);
+    for (i = 0; i < config->ops || (config->mode == BENCH_MIXED && readers_pending > 0); i++) {
+        for (off = 0; off < config->line_size; off += len) {
+            len = min(chunk, config->line_size - off);
+            ret = aesd_harness_write(&hf, line + off, len);
+            if (ret == -EAGAIN) {
+                /* AESD_FULL_FAIL, wait for the readers and try again */
+                sched_yield();
+                len = 0;
+                continue;
+            }
+            if (ret != (ssize_t)len) {
+                fprintf(stderr, "write failed after %ld lines\n", i);
+                goto exit;
+            }
+            t->ops++;
+            t->bytes += len;
+        }
+    }
+
+exit:
+    aesd_harness_release(&hf);
+    free(line);
+    return NULL;
+}
+
+static void *bench_reader(void *arg)
+{
+    struct bench_thread *t = arg;
+    struct bench_config *config = t->config;
+    struct aesd_harness_file hf;
+    struct aesd_seekto seekto;
+    struct aesd_tail_read tail;
+    char buf[BENCH_READ_SIZE];
+    ssize_t ret;
+
+    memset(&tail, 0, sizeof(tail));
+    aesd_harness_open(&hf, &bench_dev, config->mode == BENCH_MIXED ? 0 : O_NONBLOCK);
+
+    while (config->mode == BENCH_MIXED || t->ops < config->ops) {
+        switch (config->mode) {
+            case BENCH_READ:
+                ret = aesd_harness_read(&hf, buf, sizeof(buf));
+                if (ret == 0) {
+                    aesd_harness_lseek(&hf, 0, SEEK_SET);
+                }
+                break;
+
+            case BENCH_SEEK:
+                seekto.write_cmd = rand_r(&t->seed) % AESDCHAR_MAX_ENTRIES;
+                seekto.write_cmd_offset = 0;
+                ret = 0;
+                if (aesd_harness_ioctl(&hf, AESDCHAR_IOCSEEKTO, &seekto) == 0) {
+                    ret = aesd_harness_read(&hf, buf, sizeof(buf));
+                }
+                break;
+
+            default:
+                /* Once the writers are done, drain without waiting for more */
+                if (writers_done) {
+                    hf.filp.f_flags |= O_NONBLOCK;
+                }
+                tail.buf = (uintptr_t)buf;
+                tail.len = sizeof(buf);
+                ret = aesd_harness_ioctl(&hf, AESDCHAR_IOCTAILREAD, &tail);
+                if (ret < 0) {
+                    goto exit;
+                }
+                if (t->ops + 1 == config->ops) {
+                    readers_pending--;
+                }
+                break;
+        }
+
+        t->ops++;
+        if (ret > 0) {
+            t->bytes += ret;
+        }
+    }
+
+exit:
+    aesd_harness_release(&hf);
+    return NULL;
+}
+
+/**
+ * Append one more line, so readers which blocked before seeing writers_done wake up to drain
+ */
+static void bench_wake_readers(void)
+{
+    struct aesd_harness_file hf;
+
+    aesd_harness_open(&hf, &bench_dev, 0);
+    while (aesd_harness_write(&hf, "\n", 1) == -EAGAIN) {
+        sched_yield();
+    }
+    aesd_harness_release(&hf);
+}
+
+/**
+ * Fill the ring before a read only run
+ */
+static int bench_prefill(struct bench_config *config)
+{
+    struct bench_config fill = *config;
+    struct bench_thread t = { .config = &fill };
+
+    fill.ops = AESDCHAR_MAX_ENTRIES;
+    fill.chunks = 1;
+    bench_writer(&t);
+    return t.ops == AESDCHAR_MAX_ENTRIES ? 0 : -1;
+}
+
+/**
+ * @return the upper bound in ns of the bucket holding the @param percent percentile of @param hist
+ */
+static u64 bench_percentile(const u64 *hist, int percent)
+{
+    u64 total = 0;
+    u64 seen = 0;
+    int i;
+
+    for (i = 0; i < AESD_LOCK_HIST_BUCKETS; i++) {
+        total += hist[i];
+    }
+    for (i = 0; i < AESD_LOCK_HIST_BUCKETS; i++) {
+        seen += hist[i];
+        if (total > 0 && seen * 100 >= total * percent) {
+            return 2ULL << i;
+        }
+    }
+    return 0;
+}
+
+static void bench_report(struct bench_config *config, struct bench_thread *threads, int count, double elapsed)
+{
+    static const char *names[AESD_STAT_NR] = {
+        "writes", "reads", "bytes_written", "bytes_read", "evictions", "partial_write_bytes",
+        "ioctls", "reclaimed", "orphan_dropped_bytes",
+    };
+    struct aesd_stats sum;
+    long ops = 0;
+    u64 bytes = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        ops += threads[i].ops;
+        bytes += threads[i].bytes;
+    }
+
+    printf("mode=%s writers=%d readers=%d line_size=%zu chunks=%d policy=%d\n",
+            bench_mode_names[config->mode], config->writers, config->readers, config->line_size,
+            config->chunks, aesd_full_policy);
+    printf("elapsed_s: %.3f\n", elapsed);
+    printf("ops: %ld\n", ops);
+    printf("ns_per_op: %.1f\n", ops ? elapsed * 1e9 * count / ops : 0.0);
+    printf("mb_per_s: %.1f\n", bytes / elapsed / 1e6);
+
+    aesd_harness_stats(&bench_dev, &sum);
+    for (i = 0; i < AESD_STAT_NR; i++) {
+        printf("%s: %llu\n", names[i], sum.count[i]);
+    }
+    printf("lock_wait_ns p50<=%llu p99<=%llu\n", bench_percentile(sum.lock_wait, 50),
+            bench_percentile(sum.lock_wait, 99));
+    printf("lock_hold_ns p50<=%llu p99<=%llu\n", bench_percentile(sum.lock_hold, 50),
+            bench_percentile(sum.lock_hold, 99));
+}
+
+static void bench_usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-m write|read|seek|mixed] [-w writers] [-r readers] [-n ops]\n"
+            "          [-s line size] [-c chunks per line] [-p full policy] [-d]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_config config = {
+        .mode = BENCH_MIXED,
+        .writers = 2,
+        .readers = 2,
+        .ops = 100000,
+        .line_size = 64,
+        .chunks = 1,
+    };
+    struct bench_thread *threads;
+    struct timespec start;
+    struct timespec end;
+    int count;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "m:w:r:n:s:c:p:d")) != -1) {
+        switch (opt) {
+            case 'm':
+                for (i = 0; i <= BENCH_MIXED && strcmp(optarg, bench_mode_names[i]) != 0; i++);
+                if (i > BENCH_MIXED) {
+                    bench_usage(argv[0]);
+                    return 1;
+                }
+                config.mode = i;
+                break;
+            case 'w': config.writers = atoi(optarg); break;
+            case 'r': config.readers = atoi(optarg); break;
+            case 'n': config.ops = atol(optarg); break;
+            case 's': config.line_size = strtoul(optarg, NULL, 0); break;
+            case 'c': config.chunks = atoi(optarg); break;
+            case 'p': aesd_full_policy = atoi(optarg); break;
+            case 'd': aesd_debug = true; break;
+            default:
+                bench_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (config.mode == BENCH_WRITE) {
+        config.readers = 0;
+    } else if (config.mode != BENCH_MIXED) {
+        config.writers = 0;
+    } else {
+        aesd_blocking_reads = true;
+    }
+    if (config.line_size < 1 || config.chunks < 1 || config.writers + config.readers < 1 ||
+            (config.mode == BENCH_MIXED && config.writers < 1) ||
+            (aesd_full_policy == AESD_FULL_BLOCK && config.readers < 1)) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    if (aesd_harness_dev_init(&bench_dev) != 0) {
+        return 1;
+    }
+    if (config.writers == 0 && bench_prefill(&config) != 0) {
+        return 1;
+    }
+
+    count = config.writers + config.readers;
+    threads = calloc(count, sizeof(*threads));
+    if (!threads) {
+        return 1;
+    }
+
+    readers_pending = config.mode == BENCH_MIXED ? config.readers : 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < count; i++) {
+        threads[i].config = &config;
+        threads[i].seed = i + 1;
+        pthread_create(&threads[i].thread, NULL, i < config.writers ? bench_writer : bench_reader,
+                &threads[i]);
+    }
+    for (i = 0; i < config.writers; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+    writers_done = true;
+    if (config.mode == BENCH_MIXED) {
+        bench_wake_readers();
+    }
+    for (; i < count; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    bench_report(&config, threads, count,
+            (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+    free(threads);
+    aesd_harness_dev_cleanup(&bench_dev);
+    return 0;
+}
@@ -0,0 +1,191 @@
+/**
+ * @file aesd-circular-buffer-arena-test.c
+ * @brief Randomized check of the arena buffer in aesd-circular-buffer-arena.h against the
+ * reference buffer
+ *
+ * Usage: aesd-circular-buffer-arena-test [-n rounds] [-s seed]
+ *
+ * Every round picks an arena of 1 to 64 bytes with 8 record headers and drives it and a
+ * reference buffer through the same random sequence of operations:
+ *
+ * add          aesd_arena_buffer_add_record of a record of 0 to 2 bytes more than the arena.
+ *              The reference drops its oldest entries until the bytes and the header fit, and
+ *              the arena must report removing as many; a record larger than the arena must
+ *              fail with -EINVAL and change nothing
+ * remove       aesd_arena_buffer_remove_record, against aesd_circular_buffer_remove_entry
+ *
+ * and checks after each one that both hold records of the same sizes, that
+ * aesd_arena_buffer_copy returns the concatenated bytes of the reference entries for the whole
+ * data and a random range of it, and that aesd_arena_buffer_find_record_offset_for_fpos returns
+ * the record and offset matching the reference for every position up to one past the end.
+ * Small arenas make records wrap past the end of the arena and evict on bytes rather than on
+ * headers most of the time.
+ *
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aesd-circular-buffer.h"
+#include "aesd-circular-buffer-arena.h"
+
+#define TEST_RECORDS 8
+#define TEST_MAX_ARENA 64
+#define TEST_MAX_RECORD (TEST_MAX_ARENA + 2)
+#define TEST_STEPS 60
+#define TEST_DATA TEST_STEPS
+
+#define TEST_CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed in round %ld: %s\n", __FILE__, __LINE__, test_round, #cond); \
+        exit(EXIT_FAILURE); \
+    } \
+} while (0)
+
+/* Bytes of every record added in a round, which the reference entries point to */
+static char test_data[TEST_DATA][TEST_MAX_RECORD];
+static long test_round;
+
+static int test_random(int bound)
+{
+    return bound > 0 ? rand() % bound : 0;
+}
+
+static struct aesd_buffer_entry *test_reference_at(struct aesd_circular_buffer *reference, uint8_t index)
+{
+    return &reference->entry[(reference->out_offs + index) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+}
+
+static size_t test_reference_used(struct aesd_circular_buffer *reference)
+{
+    size_t used = 0;
+    uint8_t i;
+
+    for (i = 0; i < aesd_circular_buffer_count(reference); i++) {
+        used += test_reference_at(reference, i)->size;
+    }
+    return used;
+}
+
+static void test_add(struct aesd_arena_buffer *arena, struct aesd_circular_buffer *reference, int data)
+{
+    struct aesd_buffer_entry entry = {
+        .buffptr = test_data[data],
+        .size = test_random(arena->arena_size + 3),
+    };
+    int expected = 0;
+    int i;
+
+    for (i = 0; i < entry.size; i++) {
+        test_data[data][i] = 'a' + test_random(26);
+    }
+
+    if (entry.size > arena->arena_size) {
+        TEST_CHECK(aesd_arena_buffer_add_record(arena, entry.buffptr, entry.size) == -EINVAL);
+        return;
+    }
+
+    while (test_reference_used(reference) + entry.size > arena->arena_size ||
+            aesd_circular_buffer_count(reference) > arena->mask) {
+        TEST_CHECK(aesd_circular_buffer_remove_entry(reference) != NULL);
+        expected++;
+    }
+    TEST_CHECK(aesd_circular_buffer_add_entry(reference, &entry) == NULL);
+    TEST_CHECK(aesd_arena_buffer_add_record(arena, entry.buffptr, entry.size) == expected);
+}
+
+static void test_compare(struct aesd_arena_buffer *arena, struct aesd_circular_buffer *reference)
+{
+    struct aesd_buffer_entry *expected;
+    struct aesd_arena_record *found;
+    char concatenated[TEST_MAX_ARENA];
+    char copied[TEST_MAX_ARENA];
+    size_t expected_offset = 0;
+    size_t found_offset = 0;
+    size_t total = 0;
+    size_t offset;
+    size_t len;
+    size_t pos;
+    uint8_t count = aesd_circular_buffer_count(reference);
+    uint8_t i;
+
+    TEST_CHECK(aesd_arena_buffer_count(arena) == count);
+    for (i = 0; i < count; i++) {
+        TEST_CHECK(aesd_arena_buffer_at(arena, i)->size == test_reference_at(reference, i)->size);
+        memcpy(concatenated + total, test_reference_at(reference, i)->buffptr, test_reference_at(reference, i)->size);
+        total += test_reference_at(reference, i)->size;
+    }
+    TEST_CHECK(arena->used == total);
+
+    TEST_CHECK(aesd_arena_buffer_copy(arena, 0, copied, sizeof(copied)) == total);
+    TEST_CHECK(memcmp(copied, concatenated, total) == 0);
+    offset = test_random(total + 2);
+    len = test_random(total + 2);
+    if (offset >= total) {
+        TEST_CHECK(aesd_arena_buffer_copy(arena, offset, copied, len) == 0);
+    } else {
+        len = aesd_arena_buffer_copy(arena, offset, copied, len);
+        TEST_CHECK(len <= total - offset);
+        TEST_CHECK(memcmp(copied, concatenated + offset, len) == 0);
+    }
+
+    for (pos = 0; pos <= total; pos++) {
+        expected = aesd_circular_buffer_find_entry_offset_for_fpos(reference, pos, &expected_offset);
+        found = aesd_arena_buffer_find_record_offset_for_fpos(arena, pos, &found_offset);
+        TEST_CHECK((found == NULL) == (expected == NULL));
+        if (found != NULL) {
+            for (i = 0; test_reference_at(reference, i) != expected; i++);
+            TEST_CHECK(found == aesd_arena_buffer_at(arena, i));
+            TEST_CHECK(found_offset == expected_offset);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct aesd_arena_record records[TEST_RECORDS];
+    char bytes[TEST_MAX_ARENA];
+    struct aesd_circular_buffer reference;
+    struct aesd_arena_buffer arena;
+    long rounds = 5000;
+    unsigned int seed = 1;
+    int step;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n': rounds = atol(optarg); break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "Usage: %s [-n rounds] [-s seed]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    srand(seed);
+
+    test_round = -1;
+    TEST_CHECK(aesd_arena_buffer_init(&arena, bytes, 0, records, TEST_RECORDS) == -EINVAL);
+    TEST_CHECK(aesd_arena_buffer_init(&arena, bytes, sizeof(bytes), records, 6) == -EINVAL);
+
+    for (test_round = 0; test_round < rounds; test_round++) {
+        TEST_CHECK(aesd_arena_buffer_init(&arena, bytes, 1 + test_random(TEST_MAX_ARENA), records,
+                TEST_RECORDS) == 0);
+        aesd_circular_buffer_init(&reference);
+
+        for (step = 0; step < TEST_STEPS; step++) {
+            if (test_random(3) > 0) {
+                test_add(&arena, &reference, step);
+            } else {
+                TEST_CHECK(aesd_arena_buffer_remove_record(&arena) ==
+                        (aesd_circular_buffer_remove_entry(&reference) != NULL));
+            }
+            test_compare(&arena, &reference);
+        }
+    }
+
+    printf("aesd-circular-buffer-arena-test: %ld rounds passed\n", rounds);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,544 @@
+/**
+ * @file aesd-circular-buffer-bench.c
+ * @brief Single-threaded microbenchmark of the circular buffer variants
+ *
+ * Usage: aesd-circular-buffer-bench [-v classic|pow2|arena] [-c capacity] [-s entry size]
+ *                                   [-n ops] [-r reads per write]
+ *
+ * Without -c and -s every variant runs over a grid of capacities and entry sizes.  classic is
+ * always AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED entries and ignores -c.  Each line reports:
+ *
+ * add          adding an entry to a full buffer, overwriting the oldest one
+ * find_head    find_entry_offset_for_fpos of the first byte
+ * find_mid     ... of the middle byte
+ * find_tail    ... of the last byte
+ * iterate      one pass over every live entry, summing all of its bytes
+ * mixed        -r lookups of a random byte, each reading up to 64 bytes, for every add
+ *
+ * as ns per operation and, where perf_event_open is permitted, hardware cache references and
+ * misses per operation.  Run it on an idle machine, pinned with taskset for stable numbers.
+ *
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "aesd-circular-buffer.h"
+#include "aesd-circular-buffer-pow2.h"
+#include "aesd-circular-buffer-arena.h"
+
+#define BENCH_MIXED_READ_SIZE 64
+
+enum bench_variant
+{
+    BENCH_CLASSIC,
+    BENCH_POW2,
+    BENCH_ARENA,
+    BENCH_VARIANT_NR,
+};
+
+static const char *bench_variant_names[] = {
+    [BENCH_CLASSIC] = "classic",
+    [BENCH_POW2] =    "pow2",
+    [BENCH_ARENA] =   "arena",
+};
+
+static const uint32_t bench_default_capacities[] = { 8, 64, 1024, 8192 };
+static const size_t bench_default_sizes[] = { 16, 256, 4096 };
+
+struct bench_config
+{
+    long ops;
+    int reads_per_write;
+};
+
+/**
+ * One buffer under test with the payloads its entries point to
+ */
+struct bench_buffer
+{
+    enum bench_variant variant;
+    uint32_t capacity;
+    size_t entry_size;
+    /**
+     * capacity + 1 payloads of entry_size bytes, used round robin so an add never reuses
+     * the payload of an entry still live
+     */
+    char *payload;
+    uint32_t next_payload;
+    size_t total_size;
+
+    struct aesd_circular_buffer classic;
+    struct aesd_pow2_buffer pow2;
+    struct aesd_buffer_entry *storage;
+    struct aesd_arena_buffer arena;
+    char *arena_bytes;
+    struct aesd_arena_record *records;
+};
+
+/**
+ * Hardware cache counters of the calling thread, group leader first.  fd[0] is -1 when the
+ * kernel or the container does not allow perf_event_open.
+ */
+struct bench_counters
+{
+    int fd[2];
+    uint64_t references;
+    uint64_t misses;
+};
+
+/* Keeps the compiler from dropping results nobody reads */
+static volatile uint64_t bench_sink;
+
+/*               COUNTERS               */
+
+static int bench_perf_open(uint64_t config, int group_fd)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = group_fd == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static void bench_counters_init(struct bench_counters *counters)
+{
+    counters->fd[0] = bench_perf_open(PERF_COUNT_HW_CACHE_REFERENCES, -1);
+    counters->fd[1] = -1;
+    if (counters->fd[0] >= 0) {
+        counters->fd[1] = bench_perf_open(PERF_COUNT_HW_CACHE_MISSES, counters->fd[0]);
+        if (counters->fd[1] < 0) {
+            close(counters->fd[0]);
+            counters->fd[0] = -1;
+        }
+    }
+    if (counters->fd[0] < 0) {
+        fprintf(stderr, "perf_event_open: %s, cache counters disabled\n", strerror(errno));
+    }
+}
+
+static void bench_counters_close(struct bench_counters *counters)
+{
+    if (counters->fd[0] >= 0) {
+        close(counters->fd[1]);
+        close(counters->fd[0]);
+    }
+}
+
+static void bench_counters_start(struct bench_counters *counters)
+{
+    if (counters->fd[0] >= 0) {
+        ioctl(counters->fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(counters->fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+static void bench_counters_stop(struct bench_counters *counters)
+{
+    /* nr, then one value per event of the group */
+    uint64_t values[3];
+
+    counters->references = 0;
+    counters->misses = 0;
+    if (counters->fd[0] < 0) {
+        return;
+    }
+    ioctl(counters->fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    if (read(counters->fd[0], values, sizeof(values)) == sizeof(values)) {
+        counters->references = values[1];
+        counters->misses = values[2];
+    }
+}
+
+/*               BUFFER UNDER TEST               */
+
+static int bench_buffer_init(struct bench_buffer *b, enum bench_variant variant, uint32_t capacity,
+            size_t entry_size)
+{
+    memset(b, 0, sizeof(*b));
+    b->variant = variant;
+    b->capacity = variant == BENCH_CLASSIC ? AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED : capacity;
+    b->entry_size = entry_size;
+
+    b->payload = malloc((size_t)(b->capacity + 1) * entry_size);
+    if (!b->payload) {
+        return -ENOMEM;
+    }
+    memset(b->payload, 'a', (size_t)(b->capacity + 1) * entry_size);
+
+    switch (variant) {
+        case BENCH_CLASSIC:
+            aesd_circular_buffer_init(&b->classic);
+            return 0;
+
+        case BENCH_POW2:
+            b->storage = calloc(b->capacity, sizeof(*b->storage));
+            if (!b->storage) {
+                return -ENOMEM;
+            }
+            return aesd_pow2_buffer_init(&b->pow2, b->storage, b->capacity);
+
+        default:
+            if ((size_t)b->capacity * entry_size > UINT32_MAX) {
+                return -EINVAL;
+            }
+            b->arena_bytes = malloc((size_t)b->capacity * entry_size);
+            b->records = calloc(b->capacity, sizeof(*b->records));
+            if (!b->arena_bytes || !b->records) {
+                return -ENOMEM;
+            }
+            return aesd_arena_buffer_init(&b->arena, b->arena_bytes, b->capacity * entry_size,
+                    b->records, b->capacity);
+    }
+}
+
+static void bench_buffer_free(struct bench_buffer *b)
+{
+    free(b->payload);
+    free(b->storage);
+    free(b->arena_bytes);
+    free(b->records);
+}
+
+/**
+ * Add the next payload as the newest entry.  Payloads are owned by the benchmark, so replaced
+ * entries are not freed.
+ */
+static void bench_add(struct bench_buffer *b)
+{
+    struct aesd_buffer_entry entry;
+
+    entry.buffptr = b->payload + (size_t)b->next_payload * b->entry_size;
+    entry.size = b->entry_size;
+    if (++b->next_payload > b->capacity) {
+        b->next_payload = 0;
+    }
+
+    switch (b->variant) {
+        case BENCH_CLASSIC:
+            aesd_circular_buffer_add_entry(&b->classic, &entry);
+            break;
+        case BENCH_POW2:
+            aesd_pow2_buffer_add_entry(&b->pow2, &entry);
+            break;
+        default:
+            aesd_arena_buffer_add_record(&b->arena, entry.buffptr, entry.size);
+            break;
+    }
+}
+
+/**
+ * @return the address of byte @param char_offset of the concatenated entries, or NULL, with the
+ * number of bytes readable from there without crossing an entry stored at @param len_rtn
+ */
+static const char *bench_find(struct bench_buffer *b, size_t char_offset, size_t *len_rtn)
+{
+    struct aesd_buffer_entry *entry;
+    struct aesd_arena_record *record;
+    size_t offset_byte;
+    size_t pos;
+
+    switch (b->variant) {
+        case BENCH_CLASSIC:
+            entry = aesd_circular_buffer_find_entry_offset_for_fpos(&b->classic, char_offset, &offset_byte);
+            break;
+        case BENCH_POW2:
+            entry = aesd_pow2_buffer_find_entry_offset_for_fpos(&b->pow2, char_offset, &offset_byte);
+            break;
+        default:
+            record = aesd_arena_buffer_find_record_offset_for_fpos(&b->arena, char_offset, &offset_byte);
+            if (!record) {
+                return NULL;
+            }
+            pos = record->offset + offset_byte;
+            if (pos >= b->arena.arena_size) {
+                pos -= b->arena.arena_size;
+            }
+            *len_rtn = record->size - offset_byte;
+            if (*len_rtn > b->arena.arena_size - pos) {
+                *len_rtn = b->arena.arena_size - pos;
+            }
+            return b->arena_bytes + pos;
+    }
+
+    if (!entry) {
+        return NULL;
+    }
+    *len_rtn = entry->size - offset_byte;
+    return entry->buffptr + offset_byte;
+}
+
+static uint64_t bench_sum_bytes(const char *bytes, size_t len)
+{
+    uint64_t sum = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        sum += (unsigned char)bytes[i];
+    }
+    return sum;
+}
+
+/**
+ * @return the sum of every byte held, visiting entries from oldest to newest
+ */
+static uint64_t bench_iterate(struct bench_buffer *b)
+{
+    struct aesd_buffer_entry *entry;
+    uint64_t sum = 0;
+    uint32_t counter;
+    uint8_t index;
+    uint32_t first;
+
+    switch (b->variant) {
+        case BENCH_CLASSIC:
+            AESD_CIRCULAR_BUFFER_FOREACH(entry, &b->classic, index) {
+                sum += bench_sum_bytes(entry->buffptr, entry->size);
+            }
+            break;
+        case BENCH_POW2:
+            AESD_POW2_BUFFER_FOREACH_LIVE(entry, &b->pow2, counter) {
+                sum += bench_sum_bytes(entry->buffptr, entry->size);
+            }
+            break;
+        default:
+            /* The live bytes are one run wrapping at most once, no need to look at the records */
+            first = b->arena.arena_size - b->arena.start;
+            if (b->arena.used <= first) {
+                sum = bench_sum_bytes(b->arena_bytes + b->arena.start, b->arena.used);
+            } else {
+                sum = bench_sum_bytes(b->arena_bytes + b->arena.start, first);
+                sum += bench_sum_bytes(b->arena_bytes, b->arena.used - first);
+            }
+            break;
+    }
+    return sum;
+}
+
+/*               BENCHMARKS               */
+
+static double bench_now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+/**
+ * xorshift32, cheap enough not to show up in the mixed numbers
+ */
+static uint32_t bench_rand(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static void bench_report(struct bench_buffer *b, const char *name, long ops, double ns,
+            struct bench_counters *counters)
+{
+    printf("%-8s %9u %9zu  %-10s %12.1f", bench_variant_names[b->variant], b->capacity, b->entry_size,
+            name, ns / ops);
+    if (counters->fd[0] >= 0) {
+        printf(" %12.2f %12.2f\n", (double)counters->references / ops, (double)counters->misses / ops);
+    } else {
+        printf(" %12s %12s\n", "n/a", "n/a");
+    }
+}
+
+/**
+ * Run every benchmark over one variant, capacity and entry size
+ */
+static int bench_run(struct bench_config *config, enum bench_variant variant, uint32_t capacity,
+            size_t entry_size, struct bench_counters *counters)
+{
+    struct bench_buffer b;
+    uint32_t seed = 2463534242u;
+    uint64_t acc = 0;
+    const char *byte;
+    size_t len;
+    long passes;
+    double start;
+    double ns;
+    long i;
+    int ret;
+
+    ret = bench_buffer_init(&b, variant, capacity, entry_size);
+    if (ret != 0) {
+        fprintf(stderr, "%s capacity=%u size=%zu: %s\n", bench_variant_names[variant], capacity,
+                entry_size, strerror(-ret));
+        bench_buffer_free(&b);
+        return ret;
+    }
+
+    /* Fill the buffer, then every add of the run overwrites the oldest entry */
+    for (i = 0; i < b.capacity; i++) {
+        bench_add(&b);
+    }
+    b.total_size = (size_t)b.capacity * entry_size;
+
+    bench_counters_start(counters);
+    start = bench_now_ns();
+    for (i = 0; i < config->ops; i++) {
+        bench_add(&b);
+    }
+    ns = bench_now_ns() - start;
+    bench_counters_stop(counters);
+    bench_report(&b, "add", config->ops, ns, counters);
+
+    /* A lookup walks up to capacity entries, keep each run to about config->ops entry visits */
+    passes = config->ops / b.capacity > 0 ? config->ops / b.capacity : 1;
+
+    bench_counters_start(counters);
+    start = bench_now_ns();
+    for (i = 0; i < config->ops; i++) {
+        acc += (uintptr_t)bench_find(&b, 0, &len);
+    }
+    ns = bench_now_ns() - start;
+    bench_counters_stop(counters);
+    bench_report(&b, "find_head", config->ops, ns, counters);
+
+    bench_counters_start(counters);
+    start = bench_now_ns();
+    for (i = 0; i < passes; i++) {
+        acc += (uintptr_t)bench_find(&b, b.total_size / 2, &len);
+    }
+    ns = bench_now_ns() - start;
+    bench_counters_stop(counters);
+    bench_report(&b, "find_mid", passes, ns, counters);
+
+    bench_counters_start(counters);
+    start = bench_now_ns();
+    for (i = 0; i < passes; i++) {
+        acc += (uintptr_t)bench_find(&b, b.total_size - 1, &len);
+    }
+    ns = bench_now_ns() - start;
+    bench_counters_stop(counters);
+    bench_report(&b, "find_tail", passes, ns, counters);
+
+    /* A pass reads every byte held, keep each run to about config->ops * 64 bytes */
+    passes = config->ops * 64 / b.total_size > 0 ? config->ops * 64 / b.total_size : 1;
+
+    bench_counters_start(counters);
+    start = bench_now_ns();
+    for (i = 0; i < passes; i++) {
+        acc += bench_iterate(&b);
+    }
+    ns = bench_now_ns() - start;
+    bench_counters_stop(counters);
+    bench_report(&b, "iterate", passes, ns, counters);
+
+    /* Uniform offsets average half a walk per lookup */
+    passes = config->ops / b.capacity > 0 ? config->ops / b.capacity : 1;
+
+    bench_counters_start(counters);
+    start = bench_now_ns();
+    for (i = 0; i < passes; i++) {
+        if (i % (config->reads_per_write + 1) == 0) {
+            bench_add(&b);
+            continue;
+        }
+        byte = bench_find(&b, bench_rand(&seed) % b.total_size, &len);
+        if (byte) {
+            acc += bench_sum_bytes(byte, len < BENCH_MIXED_READ_SIZE ? len : BENCH_MIXED_READ_SIZE);
+        }
+    }
+    ns = bench_now_ns() - start;
+    bench_counters_stop(counters);
+    bench_report(&b, "mixed", passes, ns, counters);
+
+    bench_sink = acc;
+    bench_buffer_free(&b);
+    return 0;
+}
+
+static void bench_usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-v classic|pow2|arena] [-c capacity] [-s entry size] [-n ops]\n"
+            "          [-r reads per write]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_config config = {
+        .ops = 1000000,
+        .reads_per_write = 4,
+    };
+    struct bench_counters counters;
+    int variant = -1;
+    uint32_t capacity = 0;
+    size_t entry_size = 0;
+    size_t c;
+    size_t s;
+    int opt;
+    int v;
+
+    while ((opt = getopt(argc, argv, "v:c:s:n:r:")) != -1) {
+        switch (opt) {
+            case 'v':
+                for (v = 0; v < BENCH_VARIANT_NR && strcmp(optarg, bench_variant_names[v]) != 0; v++);
+                if (v == BENCH_VARIANT_NR) {
+                    bench_usage(argv[0]);
+                    return 1;
+                }
+                variant = v;
+                break;
+            case 'c': capacity = strtoul(optarg, NULL, 0); break;
+            case 's': entry_size = strtoul(optarg, NULL, 0); break;
+            case 'n': config.ops = atol(optarg); break;
+            case 'r': config.reads_per_write = atoi(optarg); break;
+            default:
+                bench_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (config.ops < 1 || config.reads_per_write < 0) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    bench_counters_init(&counters);
+    printf("%-8s %9s %9s  %-10s %12s %12s %12s\n", "variant", "capacity", "size", "bench", "ns_per_op",
+            "refs_per_op", "miss_per_op");
+
+    for (v = 0; v < BENCH_VARIANT_NR; v++) {
+        if (variant != -1 && v != variant) {
+            continue;
+        }
+        for (c = 0; c < sizeof(bench_default_capacities) / sizeof(bench_default_capacities[0]); c++) {
+            for (s = 0; s < sizeof(bench_default_sizes) / sizeof(bench_default_sizes[0]); s++) {
+                if (bench_run(&config, v, capacity ? capacity : bench_default_capacities[c],
+                        entry_size ? entry_size : bench_default_sizes[s], &counters) != 0) {
+                    bench_counters_close(&counters);
+                    return 1;
+                }
+                if (entry_size) {
+                    break;
+                }
+            }
+            /* classic has a single capacity */
+            if (capacity || v == BENCH_CLASSIC) {
+                break;
+            }
+        }
+    }
+
+    bench_counters_close(&counters);
+    return 0;
+}
@@ -0,0 +1,282 @@
+/**
+ * @file aesd-circular-buffer-lockfree-test.c
+ * @brief Concurrent correctness test of the lock-free buffers in aesd-circular-buffer-lockfree.h
+ *
+ * Usage: aesd-circular-buffer-lockfree-test [-p producers] [-c consumers] [-n entries per producer]
+ *                                           [-s capacity]
+ *
+ * spsc     one producer pushes -n numbered entries while one consumer pops them, every entry
+ *          must arrive exactly once and in order
+ * mpmc     -p producers each push -n entries numbered per producer while -c consumers pop them,
+ *          every entry must arrive exactly once, and the entries of one producer in order as
+ *          seen by any single consumer
+ *
+ * Each entry carries its producer in buffptr and its number in size.  A side finding the buffer
+ * full or empty yields, so the test also completes on a single CPU.  Each run reports its
+ * throughput.
+ *
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "aesd-circular-buffer-lockfree.h"
+
+#define TEST_MAX_THREADS 64
+
+#define TEST_CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        exit(EXIT_FAILURE); \
+    } \
+} while (0)
+
+struct test_config
+{
+    int producers;
+    int consumers;
+    long entries;
+    uint32_t capacity;
+};
+
+struct test_thread
+{
+    pthread_t thread;
+    struct test_config *config;
+    int id;
+    /**
+     * Consumer side: entries popped, and the next number expected from each producer
+     */
+    long popped;
+    size_t *next;
+};
+
+static struct aesd_spsc_buffer spsc;
+static struct aesd_mpmc_buffer mpmc;
+static char test_producer_tags[TEST_MAX_THREADS];
+static _Atomic long test_remaining;
+/* Set once per entry popped from mpmc, indexed by producer * entries + number */
+static _Atomic unsigned char *test_seen;
+
+static double test_elapsed_s(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * @return the producer index of @param entry, checking it points into test_producer_tags
+ */
+static int test_entry_producer(const struct aesd_buffer_entry *entry, int producers)
+{
+    int producer = entry->buffptr - test_producer_tags;
+
+    TEST_CHECK(producer >= 0 && producer < producers);
+    return producer;
+}
+
+static void *test_spsc_producer(void *arg)
+{
+    struct test_thread *t = arg;
+    struct aesd_buffer_entry entry = { .buffptr = &test_producer_tags[0] };
+
+    for (entry.size = 0; entry.size < t->config->entries; entry.size++) {
+        while (!aesd_spsc_buffer_push(&spsc, &entry)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *test_spsc_consumer(void *arg)
+{
+    struct test_thread *t = arg;
+    struct aesd_buffer_entry entry;
+
+    while (t->popped < t->config->entries) {
+        if (!aesd_spsc_buffer_pop(&spsc, &entry)) {
+            sched_yield();
+            continue;
+        }
+        TEST_CHECK(test_entry_producer(&entry, 1) == 0);
+        TEST_CHECK(entry.size == t->popped);
+        t->popped++;
+    }
+    return NULL;
+}
+
+static void *test_mpmc_producer(void *arg)
+{
+    struct test_thread *t = arg;
+    struct aesd_buffer_entry entry = { .buffptr = &test_producer_tags[t->id] };
+
+    for (entry.size = 0; entry.size < t->config->entries; entry.size++) {
+        while (!aesd_mpmc_buffer_push(&mpmc, &entry)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *test_mpmc_consumer(void *arg)
+{
+    struct test_thread *t = arg;
+    struct aesd_buffer_entry entry;
+    int producer;
+
+    while (atomic_load(&test_remaining) > 0) {
+        if (!aesd_mpmc_buffer_pop(&mpmc, &entry)) {
+            sched_yield();
+            continue;
+        }
+        atomic_fetch_sub(&test_remaining, 1);
+
+        /* Positions are claimed in order, so one consumer never sees a producer go backwards */
+        producer = test_entry_producer(&entry, t->config->producers);
+        TEST_CHECK(entry.size < t->config->entries);
+        TEST_CHECK(atomic_exchange(&test_seen[producer * t->config->entries + entry.size], 1) == 0);
+        TEST_CHECK(entry.size >= t->next[producer]);
+        t->next[producer] = entry.size + 1;
+        t->popped++;
+    }
+    return NULL;
+}
+
+/**
+ * Run @param producers threads of @param producer_fn and @param consumers of @param consumer_fn
+ * over the same buffer and report the throughput as @param name
+ */
+static struct test_thread *test_run(struct test_config *config, const char *name,
+        void *(*producer_fn)(void *), int producers, void *(*consumer_fn)(void *), int consumers)
+{
+    struct test_thread *threads;
+    struct timespec start;
+    double elapsed;
+    int i;
+
+    threads = calloc(producers + consumers, sizeof(*threads));
+    TEST_CHECK(threads != NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < producers + consumers; i++) {
+        threads[i].config = config;
+        threads[i].id = i < producers ? i : i - producers;
+        if (i >= producers) {
+            threads[i].next = calloc(config->producers, sizeof(*threads[i].next));
+            TEST_CHECK(threads[i].next != NULL);
+        }
+        TEST_CHECK(pthread_create(&threads[i].thread, NULL, i < producers ? producer_fn : consumer_fn,
+                &threads[i]) == 0);
+    }
+    for (i = 0; i < producers + consumers; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+    elapsed = test_elapsed_s(&start);
+
+    printf("%s producers=%d consumers=%d capacity=%u entries=%ld %.1f ns/entry %.0f entries/s\n",
+            name, producers, consumers, config->capacity, producers * config->entries,
+            elapsed * 1e9 / (producers * config->entries), producers * config->entries / elapsed);
+    return threads;
+}
+
+static void test_free(struct test_thread *threads, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        free(threads[i].next);
+    }
+    free(threads);
+}
+
+static void test_spsc(struct test_config *config)
+{
+    struct aesd_buffer_entry *storage;
+    struct aesd_buffer_entry entry;
+    struct test_thread *threads;
+
+    storage = calloc(config->capacity, sizeof(*storage));
+    TEST_CHECK(storage != NULL);
+    TEST_CHECK(aesd_spsc_buffer_init(&spsc, storage, config->capacity) == 0);
+
+    threads = test_run(config, "spsc", test_spsc_producer, 1, test_spsc_consumer, 1);
+    TEST_CHECK(threads[1].popped == config->entries);
+    TEST_CHECK(!aesd_spsc_buffer_pop(&spsc, &entry));
+
+    test_free(threads, 2);
+    free(storage);
+}
+
+static void test_mpmc(struct test_config *config)
+{
+    struct aesd_mpmc_cell *storage;
+    struct aesd_buffer_entry entry;
+    struct test_thread *threads;
+    long popped = 0;
+    int i;
+
+    storage = calloc(config->capacity, sizeof(*storage));
+    TEST_CHECK(storage != NULL);
+    TEST_CHECK(aesd_mpmc_buffer_init(&mpmc, storage, config->capacity) == 0);
+    test_seen = calloc(config->producers * config->entries, sizeof(*test_seen));
+    TEST_CHECK(test_seen != NULL);
+    atomic_store(&test_remaining, config->producers * config->entries);
+
+    threads = test_run(config, "mpmc", test_mpmc_producer, config->producers, test_mpmc_consumer,
+            config->consumers);
+
+    /* No entry was popped twice, so with the counts adding up every entry was popped once */
+    for (i = config->producers; i < config->producers + config->consumers; i++) {
+        popped += threads[i].popped;
+    }
+    TEST_CHECK(popped == config->producers * config->entries);
+    TEST_CHECK(!aesd_mpmc_buffer_pop(&mpmc, &entry));
+
+    test_free(threads, config->producers + config->consumers);
+    free((void *)test_seen);
+    free(storage);
+}
+
+int main(int argc, char *argv[])
+{
+    struct test_config config = {
+        .producers = 4,
+        .consumers = 4,
+        .entries = 200000,
+        .capacity = 64,
+    };
+    struct aesd_spsc_buffer invalid_spsc;
+    struct aesd_buffer_entry invalid_storage[3];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:c:n:s:")) != -1) {
+        switch (opt) {
+            case 'p': config.producers = atoi(optarg); break;
+            case 'c': config.consumers = atoi(optarg); break;
+            case 'n': config.entries = atol(optarg); break;
+            case 's': config.capacity = strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "Usage: %s [-p producers] [-c consumers] [-n entries per producer] [-s capacity]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (config.producers < 1 || config.producers > TEST_MAX_THREADS || config.consumers < 1 ||
+            config.consumers > TEST_MAX_THREADS || config.entries < 1) {
+        fprintf(stderr, "Producers and consumers must be 1 to %d, entries at least 1\n", TEST_MAX_THREADS);
+        return EXIT_FAILURE;
+    }
+
+    TEST_CHECK(aesd_spsc_buffer_init(&invalid_spsc, invalid_storage, 3) == -EINVAL);
+
+    test_spsc(&config);
+    test_mpmc(&config);
+    return EXIT_SUCCESS;
+}
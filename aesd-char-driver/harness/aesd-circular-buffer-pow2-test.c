@@ -0,0 +1,159 @@
+/**
+ * @file aesd-circular-buffer-pow2-test.c
+ * @brief Randomized check of the power of two buffer in aesd-circular-buffer-pow2.h against the
+ * reference buffer
+ *
+ * Usage: aesd-circular-buffer-pow2-test [-n rounds] [-s seed]
+ *
+ * Every round picks a capacity of 1, 2, 4 or 8 and drives a pow2 buffer and a reference buffer
+ * through the same random sequence of operations:
+ *
+ * add          aesd_pow2_buffer_add_entry of up to 3 entries.  When the pow2 buffer is full the
+ *              reference removes its oldest entry first, and both must give back the same one
+ * remove       aesd_pow2_buffer_remove_entry, against aesd_circular_buffer_remove_entry
+ *
+ * and checks after each one that both hold the same entries, and that
+ * aesd_pow2_buffer_find_entry_offset_for_fpos returns the same entry and offset as the reference
+ * for every position up to one past the end.  The reference holds 10 entries, so the two wrap
+ * at different points.  Half of the rounds start the pow2 counters just below UINT32_MAX, so
+ * they also wrap around zero.
+ *
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aesd-circular-buffer.h"
+#include "aesd-circular-buffer-pow2.h"
+
+#define TEST_MAX_CAPACITY 8
+#define TEST_STEPS 40
+#define TEST_STRINGS 2000
+#define TEST_STRING_SIZE 12
+
+#define TEST_CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed in round %ld: %s\n", __FILE__, __LINE__, test_round, #cond); \
+        exit(EXIT_FAILURE); \
+    } \
+} while (0)
+
+static char test_strings[TEST_STRINGS][TEST_STRING_SIZE];
+static long test_round;
+
+static int test_random(int bound)
+{
+    return bound > 0 ? rand() % bound : 0;
+}
+
+static struct aesd_buffer_entry *test_reference_at(struct aesd_circular_buffer *reference, uint8_t index)
+{
+    return &reference->entry[(reference->out_offs + index) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+}
+
+static void test_add(struct aesd_pow2_buffer *pow2, struct aesd_circular_buffer *reference, int string)
+{
+    struct aesd_buffer_entry entry = {
+        .buffptr = test_strings[string],
+        .size = strlen(test_strings[string]),
+    };
+    const char *expected = NULL;
+
+    if (aesd_pow2_buffer_full(pow2)) {
+        expected = aesd_circular_buffer_remove_entry(reference);
+    }
+    TEST_CHECK(aesd_circular_buffer_add_entry(reference, &entry) == NULL);
+    TEST_CHECK(aesd_pow2_buffer_add_entry(pow2, &entry) == expected);
+}
+
+static void test_compare(struct aesd_pow2_buffer *pow2, struct aesd_circular_buffer *reference)
+{
+    struct aesd_buffer_entry *expected;
+    struct aesd_buffer_entry *found;
+    size_t expected_offset = 0;
+    size_t found_offset = 0;
+    size_t total = 0;
+    size_t pos;
+    uint8_t count = aesd_circular_buffer_count(reference);
+    uint8_t i;
+
+    TEST_CHECK(aesd_pow2_buffer_count(pow2) == count);
+    TEST_CHECK(aesd_pow2_buffer_full(pow2) == (count == pow2->mask + 1));
+    for (i = 0; i < count; i++) {
+        TEST_CHECK(aesd_pow2_buffer_at(pow2, i)->buffptr == test_reference_at(reference, i)->buffptr);
+        TEST_CHECK(aesd_pow2_buffer_at(pow2, i)->size == test_reference_at(reference, i)->size);
+        total += test_reference_at(reference, i)->size;
+    }
+
+    for (pos = 0; pos <= total; pos++) {
+        expected = aesd_circular_buffer_find_entry_offset_for_fpos(reference, pos, &expected_offset);
+        found = aesd_pow2_buffer_find_entry_offset_for_fpos(pow2, pos, &found_offset);
+        TEST_CHECK((found == NULL) == (expected == NULL));
+        if (found != NULL) {
+            TEST_CHECK(found->buffptr == expected->buffptr);
+            TEST_CHECK(found_offset == expected_offset);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct aesd_buffer_entry storage[TEST_MAX_CAPACITY];
+    struct aesd_circular_buffer reference;
+    struct aesd_pow2_buffer pow2;
+    long rounds = 2000;
+    unsigned int seed = 1;
+    uint32_t capacity;
+    int next;
+    int count;
+    int step;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n': rounds = atol(optarg); break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "Usage: %s [-n rounds] [-s seed]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    srand(seed);
+    for (i = 0; i < TEST_STRINGS; i++) {
+        /* Sizes from 1 to 10 bytes, so positions land at every offset of an entry */
+        snprintf(test_strings[i], TEST_STRING_SIZE, "%.*s", 1 + i % 10, "0123456789");
+    }
+
+    test_round = -1;
+    TEST_CHECK(aesd_pow2_buffer_init(&pow2, storage, 0) == -EINVAL);
+    TEST_CHECK(aesd_pow2_buffer_init(&pow2, storage, 6) == -EINVAL);
+
+    for (test_round = 0; test_round < rounds; test_round++) {
+        capacity = 1u << test_random(4);
+        TEST_CHECK(aesd_pow2_buffer_init(&pow2, storage, capacity) == 0);
+        if (test_round % 2) {
+            pow2.in = pow2.out = UINT32_MAX - test_random(2 * TEST_MAX_CAPACITY);
+        }
+        aesd_circular_buffer_init(&reference);
+        next = 0;
+
+        for (step = 0; step < TEST_STEPS; step++) {
+            if (test_random(3) > 0) {
+                count = 1 + test_random(3);
+                for (i = 0; i < count; i++, next++) {
+                    test_add(&pow2, &reference, next);
+                }
+            } else {
+                TEST_CHECK(aesd_pow2_buffer_remove_entry(&pow2) == aesd_circular_buffer_remove_entry(&reference));
+            }
+            test_compare(&pow2, &reference);
+        }
+    }
+
+    printf("aesd-circular-buffer-pow2-test: %ld rounds passed\n", rounds);
+    return EXIT_SUCCESS;
+}
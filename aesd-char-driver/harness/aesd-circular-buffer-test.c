@@ -0,0 +1,214 @@
+/**
+ * @file aesd-circular-buffer-test.c
+ * @brief Randomized check of the bulk circular buffer operations against the single entry ones
+ *
+ * Usage: aesd-circular-buffer-test [-n rounds] [-s seed]
+ *
+ * Every round drives two buffers through the same random sequence of operations:
+ *
+ * add          aesd_circular_buffer_add_entries of up to 2.5 buffers worth of entries, against
+ *              one aesd_circular_buffer_add_entry per entry; both must replace the same entries
+ * pop          aesd_circular_buffer_pop_entries, against aesd_circular_buffer_remove_entry
+ * gather       aesd_circular_buffer_gather of a random range, against the bytes of the entries
+ *              concatenated from aesd_circular_buffer_peek_entries
+ *
+ * and checks after each one that both hold the same entries at the same offsets.
+ *
+ */
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aesd-circular-buffer.h"
+
+#define TEST_MAX_ENTRIES AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED
+#define TEST_MAX_ADD (TEST_MAX_ENTRIES * 5 / 2)
+#define TEST_MAX_IOV 4
+#define TEST_STEPS 20
+#define TEST_STRINGS 1000
+#define TEST_STRING_SIZE 8
+
+#define TEST_CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed in round %ld: %s\n", __FILE__, __LINE__, test_round, #cond); \
+        exit(EXIT_FAILURE); \
+    } \
+} while (0)
+
+static char test_strings[TEST_STRINGS][TEST_STRING_SIZE];
+static long test_round;
+
+static int test_random(int bound)
+{
+    return bound > 0 ? rand() % bound : 0;
+}
+
+/**
+ * Add @param count entries starting at test_strings[@param first] to @param single one at a
+ * time and to @param bulk at once
+ */
+static void test_add(struct aesd_circular_buffer *single, struct aesd_circular_buffer *bulk,
+        int first, int count)
+{
+    struct aesd_buffer_entry entries[TEST_MAX_ADD];
+    const char *replaced_single[TEST_MAX_ADD];
+    const char *replaced_bulk[TEST_MAX_ADD];
+    const char *replaced;
+    size_t nsingle = 0;
+    size_t nbulk;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < count; i++) {
+        entries[i].buffptr = test_strings[first + i];
+        entries[i].size = strlen(test_strings[first + i]);
+        replaced = aesd_circular_buffer_add_entry(single, &entries[i]);
+        if (replaced != NULL) {
+            replaced_single[nsingle++] = replaced;
+        }
+    }
+    nbulk = aesd_circular_buffer_add_entries(bulk, entries, count, replaced_bulk);
+
+    /* Entries of the batch overwritten by later ones may be reported in any order */
+    TEST_CHECK(nbulk == nsingle);
+    for (i = 0; i < nsingle; i++) {
+        for (j = 0; j < nbulk && replaced_bulk[j] != replaced_single[i]; j++);
+        TEST_CHECK(j < nbulk);
+    }
+}
+
+static void test_pop(struct aesd_circular_buffer *single, struct aesd_circular_buffer *bulk, uint8_t max)
+{
+    struct aesd_buffer_entry popped_single[TEST_MAX_ENTRIES + 2];
+    struct aesd_buffer_entry popped_bulk[TEST_MAX_ENTRIES + 2];
+    uint8_t nsingle = 0;
+    uint8_t nbulk;
+    uint8_t i;
+
+    while (nsingle < max && aesd_circular_buffer_count(single) > 0) {
+        popped_single[nsingle] = single->entry[single->out_offs];
+        aesd_circular_buffer_remove_entry(single);
+        nsingle++;
+    }
+    nbulk = aesd_circular_buffer_pop_entries(bulk, popped_bulk, max);
+
+    TEST_CHECK(nbulk == nsingle);
+    for (i = 0; i < nbulk; i++) {
+        TEST_CHECK(popped_bulk[i].buffptr == popped_single[i].buffptr);
+        TEST_CHECK(popped_bulk[i].size == popped_single[i].size);
+    }
+}
+
+static void test_gather(struct aesd_circular_buffer *buffer)
+{
+    struct aesd_buffer_entry entries[TEST_MAX_ENTRIES];
+    struct iovec iov[TEST_MAX_IOV];
+    char expected[TEST_MAX_ENTRIES * TEST_STRING_SIZE];
+    char gathered[TEST_MAX_ENTRIES * TEST_STRING_SIZE];
+    size_t total = 0;
+    size_t offset;
+    size_t len;
+    size_t got;
+    size_t pos = 0;
+    uint8_t count;
+    int niov;
+    int i;
+
+    count = aesd_circular_buffer_peek_entries(buffer, entries, TEST_MAX_ENTRIES);
+    TEST_CHECK(count == aesd_circular_buffer_count(buffer));
+    for (i = 0; i < count; i++) {
+        memcpy(expected + total, entries[i].buffptr, entries[i].size);
+        total += entries[i].size;
+    }
+
+    offset = test_random(total + 2);
+    len = test_random(5 * TEST_STRING_SIZE);
+    niov = aesd_circular_buffer_gather(buffer, offset, len, iov, TEST_MAX_IOV, &got);
+
+    for (i = 0; i < niov; i++) {
+        memcpy(gathered + pos, iov[i].iov_base, iov[i].iov_len);
+        pos += iov[i].iov_len;
+    }
+    TEST_CHECK(pos == got);
+    if (offset >= total) {
+        TEST_CHECK(niov == 0 && got == 0);
+        return;
+    }
+    TEST_CHECK(memcmp(gathered, expected + offset, got) == 0);
+    /* Short only when the data ends first or every element was used */
+    TEST_CHECK(got == len || offset + got == total || niov == TEST_MAX_IOV);
+}
+
+static void test_compare(struct aesd_circular_buffer *single, struct aesd_circular_buffer *bulk)
+{
+    struct aesd_buffer_entry entries_single[TEST_MAX_ENTRIES];
+    struct aesd_buffer_entry entries_bulk[TEST_MAX_ENTRIES];
+    uint8_t count;
+    uint8_t i;
+
+    TEST_CHECK(single->in_offs == bulk->in_offs);
+    TEST_CHECK(single->out_offs == bulk->out_offs);
+    TEST_CHECK(single->full == bulk->full);
+
+    count = aesd_circular_buffer_peek_entries(single, entries_single, TEST_MAX_ENTRIES);
+    TEST_CHECK(aesd_circular_buffer_peek_entries(bulk, entries_bulk, TEST_MAX_ENTRIES) == count);
+    for (i = 0; i < count; i++) {
+        TEST_CHECK(entries_single[i].buffptr == entries_bulk[i].buffptr);
+        TEST_CHECK(entries_single[i].size == entries_bulk[i].size);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct aesd_circular_buffer single;
+    struct aesd_circular_buffer bulk;
+    long rounds = 2000;
+    unsigned int seed = 1;
+    int next;
+    int count;
+    int step;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n': rounds = atol(optarg); break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "Usage: %s [-n rounds] [-s seed]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    srand(seed);
+    for (i = 0; i < TEST_STRINGS; i++) {
+        snprintf(test_strings[i], TEST_STRING_SIZE, "%d;", i);
+    }
+
+    for (test_round = 0; test_round < rounds; test_round++) {
+        aesd_circular_buffer_init(&single);
+        aesd_circular_buffer_init(&bulk);
+        next = 0;
+
+        for (step = 0; step < TEST_STEPS && next + TEST_MAX_ADD <= TEST_STRINGS; step++) {
+            switch (test_random(3)) {
+                case 0:
+                    count = test_random(TEST_MAX_ADD + 1);
+                    test_add(&single, &bulk, next, count);
+                    next += count;
+                    break;
+                case 1:
+                    test_pop(&single, &bulk, test_random(TEST_MAX_ENTRIES + 3));
+                    break;
+                default:
+                    test_gather(&bulk);
+                    break;
+            }
+            test_compare(&single, &bulk);
+        }
+    }
+
+    printf("aesd-circular-buffer-test: %ld rounds passed\n", rounds);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file aesd-harness.c
+ * @brief Userspace stand-in for the file operations and module setup of main.c
+ *
+ * Each call goes through the same aesd_do_* functions as the driver, so behavior and lock
+ * contention match the module apart from the costs of the kernel entry and the user copies.
+ *
+ */
+#include <stdarg.h>
+
+#include "aesd-harness.h"
+
+/**
+ * Module parameters and debug switch, which the harness owner may change before starting
+ */
+bool aesd_blocking_reads = false;
+int aesd_full_policy = AESD_FULL_OVERWRITE;
+bool aesd_debug = false;
+
+void aesd_debug_printf(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+/**
+ * Set up @param dev as aesd_init_module does for each device
+ * @return 0 on success, -ENOMEM if the counters could not be allocated
+ */
+int aesd_harness_dev_init(struct aesd_dev *dev)
+{
+    memset(dev, 0, sizeof(*dev));
+    aesd_dev_init(dev);
+
+    dev->stats = alloc_percpu(struct aesd_stats);
+    if (!dev->stats) {
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+void aesd_harness_dev_cleanup(struct aesd_dev *dev)
+{
+    aesd_dev_free_entries(dev);
+    free_percpu(dev->stats);
+}
+
+void aesd_harness_open(struct aesd_harness_file *hf, struct aesd_dev *dev, unsigned int flags)
+{
+    memset(hf, 0, sizeof(*hf));
+    aesd_file_init(&hf->file, dev);
+    hf->filp.private_data = &hf->file;
+    hf->filp.f_flags = flags;
+}
+
+void aesd_harness_release(struct aesd_harness_file *hf)
+{
+    aesd_file_release(&hf->file);
+}
+
+ssize_t aesd_harness_read(struct aesd_harness_file *hf, void *buf, size_t count)
+{
+    return aesd_do_read(&hf->filp, buf, count, &hf->filp.f_pos);
+}
+
+ssize_t aesd_harness_write(struct aesd_harness_file *hf, const void *buf, size_t count)
+{
+    return aesd_do_write(&hf->filp, buf, count, &hf->filp.f_pos);
+}
+
+long aesd_harness_ioctl(struct aesd_harness_file *hf, unsigned int cmd, void *arg)
+{
+    struct aesd_dev *dev = aesd_dev_of(&hf->filp);
+
+    AESD_STAT_INC(dev, AESD_STAT_IOCTLS);
+    return aesd_do_ioctl(&hf->filp, dev, cmd, (unsigned long)arg);
+}
+
+loff_t aesd_harness_lseek(struct aesd_harness_file *hf, loff_t offset, int whence)
+{
+    return aesd_do_llseek(&hf->filp, aesd_dev_of(&hf->filp), offset, whence);
+}
+
+void aesd_harness_stats(struct aesd_dev *dev, struct aesd_stats *sum)
+{
+    *sum = *dev->stats;
+}
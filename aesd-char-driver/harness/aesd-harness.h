@@ -0,0 +1,41 @@
+/*
+ * aesd-harness.h
+ *
+ *  @brief A userspace aesdchar device built from aesd-core.c, with open/read/write/ioctl/lseek
+ *  style calls shaped like the file operations in main.c
+ */
+
+#ifndef AESD_HARNESS_H
+#define AESD_HARNESS_H
+
+#include "aesd-compat.h"
+#include "aesdchar.h"
+#include "aesd-stats.h"
+#include "aesd-core.h"
+#include "aesd_ioctl.h"
+
+/**
+ * An open file of a harness device, the counterpart of struct file and its struct aesd_file
+ */
+struct aesd_harness_file
+{
+    struct file filp;
+    struct aesd_file file;
+};
+
+extern int aesd_harness_dev_init(struct aesd_dev *dev);
+extern void aesd_harness_dev_cleanup(struct aesd_dev *dev);
+
+extern void aesd_harness_open(struct aesd_harness_file *hf, struct aesd_dev *dev, unsigned int flags);
+extern void aesd_harness_release(struct aesd_harness_file *hf);
+extern ssize_t aesd_harness_read(struct aesd_harness_file *hf, void *buf, size_t count);
+extern ssize_t aesd_harness_write(struct aesd_harness_file *hf, const void *buf, size_t count);
+extern long aesd_harness_ioctl(struct aesd_harness_file *hf, unsigned int cmd, void *arg);
+extern loff_t aesd_harness_lseek(struct aesd_harness_file *hf, loff_t offset, int whence);
+
+/**
+ * Sum of the device counters, as shown by debugfs
+ */
+extern void aesd_harness_stats(struct aesd_dev *dev, struct aesd_stats *sum);
+
+#endif /* AESD_HARNESS_H */
@@ -17,42 +17,108 @@
 #include <linux/cdev.h>
 #include <linux/slab.h>
 #include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/kref.h>
+#include <linux/version.h>
+#include <linux/splice.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/shrinker.h>
 #include <linux/fs.h> // file_operations
 
 #include "aesdchar.h"
+#define CREATE_TRACE_POINTS
+#include "aesd-trace.h"
+#undef CREATE_TRACE_POINTS
+#include "aesd-stats.h"
+#include "aesd-core.h"
 #include "aesd_ioctl.h"
 
 int aesd_major =   0; // use dynamic major
 int aesd_minor =   0;
+int aesd_nr_devs = AESD_NR_DEVS;
+bool aesd_blocking_reads = false;
+int aesd_full_policy = AESD_FULL_OVERWRITE;
+
+struct aesd_dev *aesd_devices; /* allocated in aesd_init_module */
+/**
+ * Number of devices of aesd_devices which are set up, changed under kernel_param_lock so
+ * aesd_full_policy_set never sees a device being set up or torn down
+ */
+static int aesd_nr_ready_devs;
+
+/**
+ * Accept only the values of enum aesd_full_policy, and wake writers waiting for room, which they
+ * no longer wait for under another policy
+ */
+static int aesd_full_policy_set(const char *val, const struct kernel_param *kp)
+{
+    int policy;
+    int result;
+    int i;
+
+    result = kstrtoint(val, 0, &policy);
+    if (result) {
+        return result;
+    }
+    if (policy < AESD_FULL_OVERWRITE || policy > AESD_FULL_BLOCK) {
+        return -EINVAL;
+    }
+
+    WRITE_ONCE(aesd_full_policy, policy);
+    for (i = 0; i < aesd_nr_ready_devs; i++) {
+        wake_up_interruptible(&aesd_devices[i].write_queue);
+    }
+    return 0;
+}
+
+static const struct kernel_param_ops aesd_full_policy_ops = {
+    .set = aesd_full_policy_set,
+    .get = param_get_int,
+};
+
+module_param(aesd_nr_devs, int, S_IRUGO);
+MODULE_PARM_DESC(aesd_nr_devs, "Number of independent aesdchar devices to create");
+
+module_param(aesd_blocking_reads, bool, 0644);
+MODULE_PARM_DESC(aesd_blocking_reads, "Reads at the end of the data wait for a new entry unless O_NONBLOCK is set");
+module_param_cb(aesd_full_policy, &aesd_full_policy_ops, &aesd_full_policy, 0644);
+MODULE_PARM_DESC(aesd_full_policy, "Writes to a full ring: 0 overwrite the oldest entry, 1 fail with EAGAIN, 2 block until it is read");
 
 MODULE_AUTHOR("raffy909"); /** TODO: fill in your name **/
 MODULE_LICENSE("Dual BSD/GPL");
 
-struct aesd_dev aesd_device;
-
 int aesd_open(struct inode *inode, struct file *filp)
 {
-    struct aesd_dev *dev;
+    struct aesd_file *file;
 
     PDEBUG("open");
     
-    /**
-     * TODO: handle open
-     */
+    file = kzalloc(sizeof(*file), GFP_KERNEL);
+    if (!file) {
+        return -ENOMEM;
+    }
 
-	dev = container_of(inode->i_cdev, struct aesd_dev, cdev);
-	filp->private_data = dev;
+    aesd_file_init(file, container_of(inode->i_cdev, struct aesd_dev, cdev));
+	filp->private_data = file;
     filp->f_pos = 0;
 
     return 0;
 }
 
+static void aesd_snapshot_put(struct aesd_snapshot *snapshot);
+
 int aesd_release(struct inode *inode, struct file *filp)
 {
+    struct aesd_file *file = filp->private_data;
+
     PDEBUG("release");
-    /**
-     * TODO: handle release
-     */
+
+    aesd_file_release(file);
+    aesd_snapshot_put(file->splice_snapshot);
+    kfree(file);
     return 0;
 }
 
@@ -61,228 +127,535 @@ int aesd_release(struct inode *inode, struct file *filp)
 ssize_t aesd_read(struct file *filp, char __user *buf, size_t count,
                 loff_t *f_pos)
 {
-    size_t entry_offset_byte = 0;
-    size_t bytes_to_copy = 0;
-    
-    struct aesd_dev *dev = (struct aesd_dev *)filp->private_data;
-    struct aesd_buffer_entry *entry;
-    
-    ssize_t retval = 0;
-    
-    PDEBUG("read %zu bytes with offset %lld", count, *f_pos);
-    /**
-     * TODO: handle read
-     */
-    if (mutex_lock_interruptible(&dev->lock)) {
-        return -ERESTARTSYS;
-    }
+    struct aesd_dev *dev = aesd_dev_of(filp);
+    ssize_t retval;
 
-    entry = aesd_circular_buffer_find_entry_offset_for_fpos(&dev->buffer, *f_pos, &entry_offset_byte);
-    if (entry == NULL) {
-        mutex_unlock(&dev->lock);
-        return 0;
-    }
+    trace_aesd_read_enter(dev, count, *f_pos);
+    retval = aesd_do_read(filp, buf, count, f_pos);
+    trace_aesd_read_exit(dev, retval, *f_pos);
+    return retval;
+}
 
-    bytes_to_copy = min(count, entry->size - entry_offset_byte);
-    PDEBUG("Sending to user %s", entry->buffptr);
-    if (copy_to_user(buf, entry->buffptr + entry_offset_byte, bytes_to_copy)) {
-        retval = -EFAULT;
-        goto exit;
-    }
+ssize_t aesd_write(struct file *filp, const char __user *buf, size_t count,
+                loff_t *f_pos)
+{
+    struct aesd_dev *dev = aesd_dev_of(filp);
+    ssize_t retval;
+
+    trace_aesd_write_enter(dev, count, *f_pos);
+    retval = aesd_do_write(filp, buf, count, f_pos);
+    trace_aesd_write_exit(dev, retval, *f_pos);
+    return retval;
+}
 
-    *f_pos += bytes_to_copy;
-    retval = bytes_to_copy;
+/*          IOCTL & SEEK           */
 
-exit:
-    mutex_unlock(&dev->lock);
+static long aesd_ioctl(struct file *filp, unsigned int cmd, unsigned long arg) {
+    struct aesd_dev *dev = aesd_dev_of(filp);
+    long retval;
+
+    PDEBUG("Ioctl cmd: %u arg: %lu", cmd, arg);
+    AESD_STAT_INC(dev, AESD_STAT_IOCTLS);
+
+    trace_aesd_ioctl_enter(dev, cmd);
+    retval = aesd_do_ioctl(filp, dev, cmd, arg);
+    trace_aesd_ioctl_exit(dev, cmd, retval);
     return retval;
 }
 
-ssize_t aesd_write(struct file *filp, const char __user *buf, size_t count,
-                loff_t *f_pos)
+static loff_t aesd_llseek(struct file *filp, loff_t offset, int whence) {
+    struct aesd_dev *dev = aesd_dev_of(filp);
+    loff_t retval;
+
+    PDEBUG("seek called type: %d, offset:%lld", whence, offset);
+
+    trace_aesd_llseek_enter(dev, offset, whence);
+    retval = aesd_do_llseek(filp, dev, offset, whence);
+    trace_aesd_llseek_exit(dev, retval);
+    return retval;
+}
+
+/*              POLL               */
+
+static __poll_t aesd_poll(struct file *filp, poll_table *wait)
 {
-    struct aesd_dev *dev = (struct aesd_dev *)filp->private_data;
-    char *kbuf;
-    int newline_pos = -1;
-    ssize_t retval = -ENOMEM;
-    
-    PDEBUG("write %zu bytes with offset %lld", count, *f_pos);
-    
-    if (mutex_lock_interruptible(&dev->lock)) {
-        return -ERESTARTSYS;
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
+    __poll_t mask = 0;
+
+    poll_wait(filp, &dev->read_queue, wait);
+    poll_wait(filp, &dev->write_queue, wait);
+
+    aesd_lock(dev);
+    if (aesd_file_resume_pos(file, filp->f_pos) < dev->size) {
+        mask |= EPOLLIN | EPOLLRDNORM;
     }
-    
-    /**
-     * TODO: handle write
-     */
-    kbuf = kmalloc(count, GFP_KERNEL);
-    if(!kbuf) {
-        retval = -ENOMEM;
-        goto exit;
+    if (aesd_ring_has_room(dev)) {
+        mask |= EPOLLOUT | EPOLLWRNORM;
     }
+    aesd_unlock(dev);
+
+    return mask;
+}
+
+/*              MMAP               */
 
-    if(copy_from_user(kbuf, buf, count)) {
-        retval = -EFAULT;
-        goto exit_free;
+static void aesd_snapshot_free_pages(struct aesd_snapshot *snapshot)
+{
+    unsigned int i;
+
+    if (snapshot->area) {
+        vunmap(snapshot->area);
     }
+    for (i = 0; i < snapshot->nr_pages && snapshot->pages[i] != NULL; i++) {
+        __free_page(snapshot->pages[i]);
+    }
+    kvfree(snapshot->pages);
+}
 
-    int i;
-    for(i = 0; i < count; i++) {
-        if (kbuf[i] == '\n') {
-            newline_pos = i;
-            break;
+/**
+ * Allocate @param snapshot->area_size bytes of zeroed pages for @param snapshot, charged to the memory
+ * cgroup of the caller, and map them at snapshot->area for the kernel.  User mappings insert the
+ * same pages, see aesd_mmap.
+ * @return 0 on success, -ENOMEM if the pages or the mapping could not be allocated
+ */
+static int aesd_snapshot_alloc_pages(struct aesd_snapshot *snapshot)
+{
+    unsigned int i;
+
+    snapshot->nr_pages = snapshot->area_size >> PAGE_SHIFT;
+    snapshot->pages = kvcalloc(snapshot->nr_pages, sizeof(*snapshot->pages), GFP_KERNEL_ACCOUNT);
+    if (!snapshot->pages) {
+        return -ENOMEM;
+    }
+    for (i = 0; i < snapshot->nr_pages; i++) {
+        snapshot->pages[i] = alloc_page(GFP_KERNEL_ACCOUNT | __GFP_ZERO);
+        if (!snapshot->pages[i]) {
+            goto fail;
         }
     }
+    snapshot->area = vmap(snapshot->pages, snapshot->nr_pages, VM_MAP, PAGE_KERNEL);
+    if (!snapshot->area) {
+        goto fail;
+    }
+    return 0;
+
+fail:
+    aesd_snapshot_free_pages(snapshot);
+    return -ENOMEM;
+}
+
+static void aesd_snapshot_release(struct kref *ref)
+{
+    struct aesd_snapshot *snapshot = container_of(ref, struct aesd_snapshot, ref);
+
+    aesd_snapshot_free_pages(snapshot);
+    kfree(snapshot);
+}
+
+static void aesd_snapshot_put(struct aesd_snapshot *snapshot)
+{
+    if (snapshot != NULL) {
+        kref_put(&snapshot->ref, aesd_snapshot_release);
+    }
+}
+
+/**
+ * Return a referenced snapshot of the current contents of @param dev, copying the ring only when
+ * it changed since the last snapshot.  Caller must hold dev->lock and drop the reference with
+ * aesd_snapshot_put().
+ * @return the snapshot, or NULL if memory for it could not be allocated.
+ */
+static struct aesd_snapshot *aesd_snapshot_get(struct aesd_dev *dev)
+{
+    struct aesd_snapshot *snapshot = dev->snapshot;
+    struct aesd_mmap_header *header;
+    struct aesd_buffer_entry *entry;
+    char *data;
+    size_t offset = 0;
+    uint8_t i;
+
+    if (snapshot == NULL || snapshot->generation != dev->generation) {
+        snapshot = kzalloc(sizeof(*snapshot), GFP_KERNEL_ACCOUNT);
+        if (!snapshot) {
+            return NULL;
+        }
 
-    if(newline_pos == -1) {
-        dev->entry.buffptr = krealloc(dev->entry.buffptr, dev->entry.size + count, GFP_KERNEL);
-        if (!dev->entry.buffptr) {
-            retval = -ENOMEM;
-            goto exit_free;
+        snapshot->area_size = PAGE_SIZE + PAGE_ALIGN(dev->size);
+        if (aesd_snapshot_alloc_pages(snapshot)) {
+            kfree(snapshot);
+            return NULL;
         }
-        memcpy((void *)(dev->entry.buffptr + dev->entry.size), kbuf, count);
-        dev->entry.size += count;
-    } else {
-        size_t copy_size = newline_pos + 1;
-        
-        dev->entry.buffptr = krealloc(dev->entry.buffptr, dev->entry.size  + copy_size, GFP_KERNEL);
-        if (!dev->entry.buffptr) {
-            retval = -ENOMEM;
-            goto exit_free;
+        kref_init(&snapshot->ref);
+        snapshot->generation = dev->generation;
+        snapshot->base_offset = dev->base_offset;
+
+        header = snapshot->area;
+        data = (char *)snapshot->area + PAGE_SIZE;
+        header->generation = dev->generation;
+        header->data_offset = PAGE_SIZE;
+        header->data_size = dev->size;
+
+        header->entry_count = aesd_circular_buffer_count(&dev->buffer);
+        for (i = 0; i < header->entry_count; i++) {
+            entry = aesd_entry_at(&dev->buffer, i);
+            header->entries[i].offset = offset;
+            header->entries[i].size = entry->size;
+            memcpy(data + offset, entry->buffptr, entry->size);
+            offset += entry->size;
         }
-        
-        memcpy((void *)(dev->entry.buffptr + dev->entry.size ), kbuf, copy_size);
-        dev->entry.size  += copy_size;
 
-        aesd_circular_buffer_add_entry(&dev->buffer, &dev->entry);
-        dev->entry.buffptr = NULL;
-        dev->entry.size = 0;
+        aesd_snapshot_put(dev->snapshot);
+        dev->snapshot = snapshot;
+    }
+
+    kref_get(&snapshot->ref);
+    return snapshot;
+}
+
+static void aesd_vma_open(struct vm_area_struct *vma)
+{
+    struct aesd_snapshot *snapshot = vma->vm_private_data;
+
+    kref_get(&snapshot->ref);
+}
+
+static void aesd_vma_close(struct vm_area_struct *vma)
+{
+    aesd_snapshot_put(vma->vm_private_data);
+}
+
+static const struct vm_operations_struct aesd_vm_ops = {
+    .open =     aesd_vma_open,
+    .close =    aesd_vma_close,
+};
+
+/**
+ * Map a read-only snapshot of the device: a struct aesd_mmap_header page followed by the entries.
+ * The mapping may be shorter than the snapshot, so a caller can map the header page alone to learn
+ * the full length.
+ */
+static int aesd_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    struct aesd_dev *dev = aesd_dev_of(filp);
+    struct aesd_snapshot *snapshot;
+    unsigned long length = vma->vm_end - vma->vm_start;
+    unsigned long nr_pages = length >> PAGE_SHIFT;
+    int retval;
+
+    PDEBUG("mmap %lu bytes", length);
+
+    if (vma->vm_flags & VM_WRITE) {
+        return -EACCES;
+    }
+    if (vma->vm_pgoff != 0) {
+        return -EINVAL;
+    }
+
+    if (aesd_lock_interruptible(dev)) {
+        return -ERESTARTSYS;
+    }
+    snapshot = aesd_snapshot_get(dev);
+    aesd_unlock(dev);
+    if (snapshot == NULL) {
+        return -ENOMEM;
+    }
+
+    if (length > snapshot->area_size) {
+        retval = -EINVAL;
+        goto exit;
+    }
+
+    retval = vm_insert_pages(vma, vma->vm_start, snapshot->pages, &nr_pages);
+    if (retval) {
+        goto exit;
     }
 
-    retval = count;
-exit_free:
-    kfree(kbuf);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    vm_flags_clear(vma, VM_MAYWRITE);
+#else
+    vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+    vma->vm_ops = &aesd_vm_ops;
+    vma->vm_private_data = snapshot;
+    return 0;
+
 exit:
-    mutex_unlock(&dev->lock);
+    aesd_snapshot_put(snapshot);
     return retval;
 }
 
-/*          IOCTL & SEEK           */
+/*             SPLICE              */
 
-static long aesd_ioctl(struct file *filp, unsigned int cmd, unsigned long arg) {
-    int retval;
-    struct aesd_seekto seek_cmd;
-    struct aesd_dev *dev = filp->private_data;
-    size_t total_size = 0;
-    uint8_t i;
+static void aesd_pipe_buf_release(struct pipe_inode_info *pipe, struct pipe_buffer *buf)
+{
+    aesd_snapshot_put((struct aesd_snapshot *)buf->private);
+}
 
-    PDEBUG("Ioctl cmd: %u arg: %u", cmd, arg);
+static bool aesd_pipe_buf_get(struct pipe_inode_info *pipe, struct pipe_buffer *buf)
+{
+    struct aesd_snapshot *snapshot = (struct aesd_snapshot *)buf->private;
 
+    kref_get(&snapshot->ref);
+    return true;
+}
 
-    if (cmd == AESDCHAR_IOCSEEKTO) {
-        PDEBUG("Recived seek-to command");
-        if (copy_from_user(&seek_cmd, (const void __user *)arg, sizeof(struct aesd_seekto))) {
-            retval = -EINVAL;
-        }
-        
-        PDEBUG("data from userspace: %d, %d", seek_cmd.write_cmd, seek_cmd.write_cmd_offset);
+/**
+ * Each pipe buffer holds a reference on the snapshot owning its page
+ */
+static const struct pipe_buf_operations aesd_pipe_buf_ops = {
+    .release =  aesd_pipe_buf_release,
+    .get =      aesd_pipe_buf_get,
+};
 
-        /*
-        if (seek_cmd.write_cmd >= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) {
-            PDEBUG("Invalid command: %d", seek_cmd.write_cmd);
-            return -EINVAL;
-        }
-        */
+static void aesd_spd_release(struct splice_pipe_desc *spd, unsigned int i)
+{
+    aesd_snapshot_put((struct aesd_snapshot *)spd->partial[i].private);
+}
 
-        if (mutex_lock_interruptible(&dev->lock)) {
+/**
+ * Hand the snapshot pages holding the data at @param ppos to @param pipe by reference, so the
+ * contents reach a socket through splice() without being copied to user space.
+ *
+ * A sendfile() or splice() loop takes several calls, and the device may change between them.  The
+ * snapshot is pinned to the file, and a call starting where the previous one stopped reads on from
+ * it, so the whole transfer comes from one generation.  Any other position, or reaching the end of
+ * the pinned snapshot, starts over from a current one.
+ */
+static ssize_t aesd_splice_read(struct file *filp, loff_t *ppos, struct pipe_inode_info *pipe,
+                size_t len, unsigned int flags)
+{
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
+    struct page *pages[PIPE_DEF_BUFFERS];
+    struct partial_page partial[PIPE_DEF_BUFFERS];
+    struct splice_pipe_desc spd = {
+        .pages = pages,
+        .partial = partial,
+        .nr_pages_max = PIPE_DEF_BUFFERS,
+        .ops = &aesd_pipe_buf_ops,
+        .spd_release = aesd_spd_release,
+    };
+    struct aesd_snapshot *snapshot;
+    struct aesd_mmap_header *header;
+    size_t pos;
+    size_t end;
+    size_t chunk;
+    char *addr;
+    ssize_t retval;
+
+    PDEBUG("splice %zu bytes with offset %lld", len, *ppos);
+
+    if (mutex_lock_interruptible(&file->lock)) {
+        return -ERESTARTSYS;
+    }
+    if (file->splice_snapshot == NULL || *ppos != file->splice_pos) {
+        if (aesd_lock_interruptible(dev)) {
+            mutex_unlock(&file->lock);
             return -ERESTARTSYS;
         }
+        snapshot = aesd_snapshot_get(dev);
+        aesd_unlock(dev);
+        if (snapshot == NULL) {
+            mutex_unlock(&file->lock);
+            return -ENOMEM;
+        }
+        aesd_snapshot_put(file->splice_snapshot);
+        file->splice_snapshot = snapshot;
+        file->splice_pos = *ppos;
+    }
+    snapshot = file->splice_snapshot;
+
+    header = snapshot->area;
+    if (*ppos >= header->data_size) {
+        /* The transfer is complete, the next one starts from a current snapshot */
+        file->splice_snapshot = NULL;
+        mutex_unlock(&file->lock);
+        aesd_snapshot_put(snapshot);
+        return 0;
+    }
+    kref_get(&snapshot->ref);
+    mutex_unlock(&file->lock);
+
+    pos = *ppos;
+    end = min_t(size_t, header->data_size, pos + len);
+    while (pos < end && spd.nr_pages < PIPE_DEF_BUFFERS) {
+        addr = (char *)snapshot->area + PAGE_SIZE + pos;
+        chunk = min_t(size_t, end - pos, PAGE_SIZE - offset_in_page(addr));
+
+        pages[spd.nr_pages] = snapshot->pages[(PAGE_SIZE + pos) >> PAGE_SHIFT];
+        partial[spd.nr_pages].offset = offset_in_page(addr);
+        partial[spd.nr_pages].len = chunk;
+        partial[spd.nr_pages].private = (unsigned long)snapshot;
+        kref_get(&snapshot->ref);
+
+        spd.nr_pages++;
+        pos += chunk;
+    }
 
-        uint32_t target_entry = seek_cmd.write_cmd;
-        uint32_t entry_offset = seek_cmd.write_cmd_offset;
-        if(dev->buffer.entry[target_entry].buffptr != NULL) { //Checking if the buffer entry exist
-            
-            size_t total_size = 0;
-            struct aesd_buffer_entry *entry;
-            AESD_CIRCULAR_BUFFER_FOREACH(entry, &dev->buffer, i) {
-                total_size += entry->size;
-            }
-            
-            if (seek_cmd.write_cmd_offset < total_size){
-                PDEBUG("offset found");
-
-                struct aesd_buffer_entry *entry;
-                uint8_t index;
-                filp->f_pos = 0;
-
-                AESD_CIRCULAR_BUFFER_FOREACH(entry, &dev->buffer, index){
-                    if (index != target_entry) {
-                        filp->f_pos += entry->size;
-                        PDEBUG("1:f_pos:%d",filp->f_pos);
-                    } else {
-                        filp->f_pos += entry_offset;
-                        PDEBUG("2:f_pos:%d", filp->f_pos);
-                        retval =  0;
-                        goto exit;
-                    }
-                }
-            }
+    retval = splice_to_pipe(pipe, &spd);
+    if (retval > 0) {
+        *ppos += retval;
+
+        mutex_lock(&file->lock);
+        if (file->splice_snapshot == snapshot) {
+            file->splice_pos = *ppos;
         }
-        retval = -1;
-    } else {
-        PDEBUG("Command is not valid: %u", cmd);
-        return -ENOTTY;
+        mutex_unlock(&file->lock);
+
+        aesd_lock(dev);
+        aesd_mark_consumed(dev, snapshot->base_offset + *ppos);
+        aesd_unlock(dev);
+        AESD_STAT_INC(dev, AESD_STAT_READS);
+        AESD_STAT_ADD(dev, AESD_STAT_BYTES_READ, retval);
     }
 
-exit:
-    mutex_unlock(&dev->lock);
+    aesd_snapshot_put(snapshot);
     return retval;
 }
 
-static loff_t aesd_llseek(struct file *filp, loff_t offset, int whence) {
-    size_t total_size = 0;
-    uint8_t i;
-    struct aesd_dev *dev = filp->private_data;
+/*        MEMORY PRESSURE          */
 
-    PDEBUG("seek called type: %d, offset:%d");
+/**
+ * Reclaim is global only.  Entries and pending lines are charged to the memory cgroup of their
+ * writer, but the ring keeps the entries of every writer in write order and can only give up its
+ * oldest one, so the shrinker cannot free what one cgroup owns without dropping the entries of
+ * others written before.  The shrinker is therefore not SHRINKER_MEMCG_AWARE and only runs on
+ * global reclaim; a cgroup at its limit gets its memory back as its entries are overwritten.
+ *
+ * The objects counted are the entries of every device and the orphaned line a device may hold
+ * for the next file of the same process.  Lines pending in open files, the rest of pending_bytes,
+ * are never dropped: the writes they came from have already succeeded.
+ */
 
-    // Get bufffer current size
-    struct aesd_buffer_entry *entry;
-    AESD_CIRCULAR_BUFFER_FOREACH(entry, &dev->buffer, i) {
-        total_size += entry->size;
+/**
+ * Drop up to @param nr of the oldest entries of @param dev, as if they had been overwritten, along
+ * with its cached snapshot, and then its orphaned line.  Caller must hold dev->lock.
+ * @return the number of entries and lines freed
+ */
+static unsigned long aesd_reclaim_entries(struct aesd_dev *dev, unsigned long nr)
+{
+    struct aesd_buffer_entry *oldest;
+    unsigned long freed = 0;
+
+    while (freed < nr && aesd_circular_buffer_count(&dev->buffer) > 0) {
+        oldest = &dev->buffer.entry[dev->buffer.out_offs];
+        trace_aesd_entry_evict(dev);
+        dev->size -= oldest->size;
+        dev->base_offset += oldest->size;
+        dev->first_seq++;
+        kfree(aesd_circular_buffer_remove_entry(&dev->buffer));
+        freed++;
     }
 
-    switch (whence) {
-        case SEEK_SET:
-            if (offset < 0 || offset > total_size) {
-                return -EINVAL; 
-            }
-            filp->f_pos = offset;
-            break;
+    if (freed > 0) {
+        dev->generation++;
+        AESD_STAT_ADD(dev, AESD_STAT_RECLAIMED, freed);
+        wake_up_interruptible(&dev->write_queue);
+    }
 
-        case SEEK_CUR:
-            if (filp->f_pos + offset < 0 || filp->f_pos + offset > total_size) {
-                return -EINVAL;
-            }
-            filp->f_pos += offset; 
-            break;
+    aesd_snapshot_put(dev->snapshot);
+    dev->snapshot = NULL;
+
+    if (freed < nr && dev->orphan.entry.buffptr != NULL) {
+        AESD_STAT_ADD(dev, AESD_STAT_ORPHAN_DROPPED_BYTES, dev->orphan.entry.size);
+        atomic_long_sub(dev->orphan.capacity, &dev->pending_bytes);
+        kfree(dev->orphan.entry.buffptr);
+        memset(&dev->orphan, 0, sizeof(dev->orphan));
+        put_pid(dev->orphan_owner);
+        dev->orphan_owner = NULL;
+        freed++;
+    }
+    return freed;
+}
 
-        case SEEK_END:
-            if (offset > 0 || total_size + offset < 0) {
-                return -EINVAL;
-            }
-            filp->f_pos = total_size + offset;
-            break;
+static unsigned long aesd_shrink_count(struct shrinker *shrinker, struct shrink_control *sc)
+{
+    unsigned long count = 0;
+    int i;
 
-        default:
-            return -EINVAL;
+    /**
+     * With AESD_FULL_BLOCK writers wait for readers instead of overwriting, and reclaim must not
+     * drop entries nobody has read either
+     */
+    if (READ_ONCE(aesd_full_policy) == AESD_FULL_BLOCK) {
+        return SHRINK_EMPTY;
     }
 
-    if (filp->f_pos < 0 || filp->f_pos > total_size) {
-        return -EINVAL;
+    /**
+     * An unlocked estimate is all the shrinker needs, scan takes the locks
+     */
+    for (i = 0; i < aesd_nr_devs; i++) {
+        count += aesd_circular_buffer_count(&aesd_devices[i].buffer);
+        count += READ_ONCE(aesd_devices[i].orphan.entry.buffptr) != NULL;
+    }
+    return count ? count : SHRINK_EMPTY;
+}
+
+static unsigned long aesd_shrink_scan(struct shrinker *shrinker, struct shrink_control *sc)
+{
+    struct aesd_dev *dev;
+    unsigned long freed = 0;
+    bool locked = false;
+    int i;
+
+    if (READ_ONCE(aesd_full_policy) == AESD_FULL_BLOCK) {
+        return SHRINK_STOP;
     }
 
-    return filp->f_pos;
+    /**
+     * Reclaim can be entered from a writer holding dev->lock, so never wait for it
+     */
+    for (i = 0; i < aesd_nr_devs && freed < sc->nr_to_scan; i++) {
+        dev = &aesd_devices[i];
+        if (!aesd_trylock(dev)) {
+            continue;
+        }
+        locked = true;
+        freed += aesd_reclaim_entries(dev, sc->nr_to_scan - freed);
+        aesd_unlock(dev);
+    }
+
+    PDEBUG("shrinker freed %lu entries", freed);
+    return locked ? freed : SHRINK_STOP;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+static struct shrinker *aesd_shrinker;
+#else
+static struct shrinker aesd_shrinker_instance = {
+    .count_objects = aesd_shrink_count,
+    .scan_objects = aesd_shrink_scan,
+    .seeks = DEFAULT_SEEKS,
+};
+#endif
+
+static int aesd_shrinker_register(void)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+    aesd_shrinker = shrinker_alloc(0, "aesdchar");
+    if (!aesd_shrinker) {
+        return -ENOMEM;
+    }
+    aesd_shrinker->count_objects = aesd_shrink_count;
+    aesd_shrinker->scan_objects = aesd_shrink_scan;
+    aesd_shrinker->seeks = DEFAULT_SEEKS;
+    shrinker_register(aesd_shrinker);
+    return 0;
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(6, 0, 0)
+    return register_shrinker(&aesd_shrinker_instance, "aesdchar");
+#else
+    return register_shrinker(&aesd_shrinker_instance);
+#endif
+}
+
+static void aesd_shrinker_unregister(void)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+    shrinker_free(aesd_shrinker);
+#else
+    unregister_shrinker(&aesd_shrinker_instance);
+#endif
 }
 
 /*      DRIVER INIT & CLEANUP      */
@@ -295,75 +668,126 @@ struct file_operations aesd_fops = {
     .release =  aesd_release,
     .llseek  =  aesd_llseek,
     .unlocked_ioctl = aesd_ioctl,
+    .poll =     aesd_poll,
+    .mmap =     aesd_mmap,
+    .splice_read = aesd_splice_read,
 };
 
-static int aesd_setup_cdev(struct aesd_dev *dev)
+static int aesd_setup_cdev(struct aesd_dev *dev, int index)
 {
-    int err, devno = MKDEV(aesd_major, aesd_minor);
+    int err, devno = MKDEV(aesd_major, aesd_minor + index);
 
     cdev_init(&dev->cdev, &aesd_fops);
     dev->cdev.owner = THIS_MODULE;
     dev->cdev.ops = &aesd_fops;
     err = cdev_add (&dev->cdev, devno, 1);
     if (err) {
-        PDEBUG(KERN_ERR "Error %d adding aesd cdev", err);
+        PDEBUG(KERN_ERR "Error %d adding aesd cdev %d", err, index);
     }
     return err;
 }
 
+/**
+ * Free the entries, pending line and snapshot held by @param dev
+ */
+static void aesd_free_device(struct aesd_dev *dev)
+{
+    aesd_dev_free_entries(dev);
+    aesd_snapshot_put(dev->snapshot);
+}
+
 int aesd_init_module(void)
 {
     dev_t dev = 0;
     int result;
-    result = alloc_chrdev_region(&dev, aesd_minor, 1,
+    int i;
+
+    BUILD_BUG_ON(AESDCHAR_MAX_ENTRIES != AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED);
+    BUILD_BUG_ON(sizeof(struct aesd_mmap_header) > PAGE_SIZE);
+
+    if (aesd_nr_devs < 1) {
+        return -EINVAL;
+    }
+
+    result = alloc_chrdev_region(&dev, aesd_minor, aesd_nr_devs,
             "aesdchar");
     aesd_major = MAJOR(dev);
     if (result < 0) {
         PDEBUG(KERN_WARNING "Can't get major %d\n", aesd_major);
         return result;
     }
-    memset(&aesd_device,0,sizeof(struct aesd_dev));
+
+    aesd_devices = kcalloc(aesd_nr_devs, sizeof(struct aesd_dev), GFP_KERNEL);
+    if (!aesd_devices) {
+        unregister_chrdev_region(dev, aesd_nr_devs);
+        return -ENOMEM;
+    }
+
+    aesd_stats_module_init();
 
     /**
-     * TODO: initialize the AESD specific portion of the device
+     * Every device has its own ring and lock, so unrelated streams never contend
      */
-    mutex_init(&aesd_device.lock);
-    
-    aesd_device.entry.buffptr = NULL;
-    aesd_device.entry.size = 0;
-    
-    aesd_circular_buffer_init(&aesd_device.buffer);
+    for (i = 0; i < aesd_nr_devs; i++) {
+        aesd_dev_init(&aesd_devices[i]);
+
+        result = aesd_stats_init(&aesd_devices[i], i);
+        if (result == 0) {
+            result = aesd_setup_cdev(&aesd_devices[i], i);
+            if (result) {
+                aesd_stats_cleanup(&aesd_devices[i]);
+            }
+        }
+        if (result) {
+            goto fail;
+        }
+    }
+
+    /**
+     * Entries are charged to the writer's memory cgroup, and dropped oldest first under pressure
+     */
+    result = aesd_shrinker_register();
+    if (result) {
+        goto fail;
+    }
 
-    result = aesd_setup_cdev(&aesd_device);
+    kernel_param_lock(THIS_MODULE);
+    aesd_nr_ready_devs = aesd_nr_devs;
+    kernel_param_unlock(THIS_MODULE);
+    return 0;
 
-    if( result ) {
-        unregister_chrdev_region(dev, 1);
+fail:
+    while (i-- > 0) {
+        cdev_del(&aesd_devices[i].cdev);
+        aesd_free_device(&aesd_devices[i]);
+        aesd_stats_cleanup(&aesd_devices[i]);
     }
+    aesd_stats_module_cleanup();
+    kfree(aesd_devices);
+    unregister_chrdev_region(dev, aesd_nr_devs);
     return result;
-
 }
 
 void aesd_cleanup_module(void)
 {
-    uint8_t index;
-    struct aesd_buffer_entry *entry;
-    
+    int i;
     dev_t devno = MKDEV(aesd_major, aesd_minor);
 
-    PDEBUG("Freeing temp buffer\n");
-    if(aesd_device.entry.buffptr != NULL) {
-        kfree(aesd_device.entry.buffptr);
-    }
+    kernel_param_lock(THIS_MODULE);
+    aesd_nr_ready_devs = 0;
+    kernel_param_unlock(THIS_MODULE);
 
-    PDEBUG("Freeing main buffer\n");
-    AESD_CIRCULAR_BUFFER_FOREACH(entry, &aesd_device.buffer, index) {
-        if (entry->buffptr != NULL) {
-            kfree(entry->buffptr);
-        }
+    aesd_shrinker_unregister();
+
+    for (i = 0; i < aesd_nr_devs; i++) {
+        cdev_del(&aesd_devices[i].cdev);
+        aesd_free_device(&aesd_devices[i]);
+        aesd_stats_cleanup(&aesd_devices[i]);
     }
+    kfree(aesd_devices);
+    aesd_stats_module_cleanup();
 
-    cdev_del(&aesd_device.cdev);
-    unregister_chrdev_region(devno, 1);
+    unregister_chrdev_region(devno, aesd_nr_devs);
 }
 
 module_init(aesd_init_module);
@@ -1,4 +1,40 @@
+#define _GNU_SOURCE
 #include "systemcalls.h"
+#include <errno.h>
+#include <poll.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+extern char **environ;
+
+/**
+ * Launch @param command with posix_spawn(), which glibc implements with
+ * clone(CLONE_VM|CLONE_VFORK): the child shares the parent's memory until it execs, so no
+ * page tables are copied and launching stays cheap however large the caller is.
+ * @param file_actions are applied in the child before the exec, NULL for none.
+ * @return true if the command could be started and exited with status 0.
+ */
+static bool spawn_and_wait(char *const command[], const posix_spawn_file_actions_t *file_actions)
+{
+    pid_t pid;
+    int status;
+    int rc;
+
+    fflush(stdout);
+    rc = posix_spawn(&pid, command[0], file_actions, NULL, command, environ);
+    if (rc != 0) {
+        return false;
+    }
+
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
 
 /**
  * @param cmd the command to execute with system()
@@ -67,21 +103,9 @@ bool do_exec(int count, ...)
  *   as second argument to the execv() command.
  *
 */
-    int pid;
-    int status;
     bool ret;
-    
 
-    fflush(stdout);
-    pid = fork();
-    if (pid == -1) {
-        ret = false;
-    } else if (pid == 0) {
-        execv(command[0], command); // If this fails exit(-1) will run
-        exit(-1);
-    }
-    if (waitpid (pid, &status, 0) == -1)
-        ret = false;
+    ret = spawn_and_wait(command, NULL);
 
     va_end(args);
 
@@ -116,36 +140,317 @@ bool do_exec_redirect(const char *outputfile, int count, ...)
  *   The rest of the behaviour is same as do_exec()
  *
 */
-    bool ret;
+    bool ret = false;
+    posix_spawn_file_actions_t file_actions;
+
+    // The child opens outputfile straight onto its stdout, nothing to dup2 or close here
+    if (posix_spawn_file_actions_init(&file_actions) == 0) {
+        if (posix_spawn_file_actions_addopen(&file_actions, STDOUT_FILENO, outputfile,
+                                             O_WRONLY|O_CREAT|O_TRUNC, 0644) == 0) {
+            ret = spawn_and_wait(command, &file_actions);
+        }
+        posix_spawn_file_actions_destroy(&file_actions);
+    }
+    va_end(args);
+
+    return ret;
+}
 
-    int pid;
+/* Bytes read from a command pipe per read() call */
+#define BATCH_READ_SIZE 4096
+
+/* Poll timeout while a command without a pidfd has to be reaped by polling waitpid() */
+#define BATCH_REAP_POLL_MS 10
+
+/**
+ * A command of do_exec_batch() currently running, with the read ends of its stdout and stderr
+ * pipes, -1 once they reached end of file, and a pidfd becoming readable when it exits, -1 if
+ * the kernel has no pidfd_open() or once it was reaped.
+ */
+struct batch_slot {
+    int index;
+    pid_t pid;
+    int fds[2];
+    int pidfd;
+    bool reaped;
+    struct timespec start;
+};
+
+static double elapsed_ms_since(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static int batch_pidfd_open(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return syscall(SYS_pidfd_open, pid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/**
+ * Start @param command with its stdout and stderr on new pipes, filling @param slot.
+ * @return true if the command could be started.
+ */
+static bool batch_launch(char *const command[], struct batch_slot *slot)
+{
+    posix_spawn_file_actions_t file_actions;
+    int out_pipe[2] = { -1, -1 };
+    int err_pipe[2] = { -1, -1 };
+    bool ret = false;
+
+    // Keep the pipes out of the other commands of the batch, the parent only reads without blocking
+    if (pipe2(out_pipe, O_CLOEXEC) == -1 || pipe2(err_pipe, O_CLOEXEC) == -1 ||
+        fcntl(out_pipe[0], F_SETFL, O_NONBLOCK) == -1 ||
+        fcntl(err_pipe[0], F_SETFL, O_NONBLOCK) == -1) {
+        goto exit;
+    }
+
+    if (posix_spawn_file_actions_init(&file_actions) != 0) {
+        goto exit;
+    }
+    if (posix_spawn_file_actions_adddup2(&file_actions, out_pipe[1], STDOUT_FILENO) == 0 &&
+        posix_spawn_file_actions_adddup2(&file_actions, err_pipe[1], STDERR_FILENO) == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &slot->start);
+        ret = posix_spawn(&slot->pid, command[0], &file_actions, NULL, command, environ) == 0;
+    }
+    posix_spawn_file_actions_destroy(&file_actions);
+
+exit:
+    if (out_pipe[1] != -1) {
+        close(out_pipe[1]);
+    }
+    if (err_pipe[1] != -1) {
+        close(err_pipe[1]);
+    }
+    if (ret) {
+        slot->fds[0] = out_pipe[0];
+        slot->fds[1] = err_pipe[0];
+        slot->pidfd = batch_pidfd_open(slot->pid);
+        slot->reaped = false;
+    } else {
+        if (out_pipe[0] != -1) {
+            close(out_pipe[0]);
+        }
+        if (err_pipe[0] != -1) {
+            close(err_pipe[0]);
+        }
+    }
+    return ret;
+}
+
+/**
+ * Append what can be read from @param fd to @param buf, growing it as needed.
+ * @return 1 if more may come, 0 on end of file, -1 if reading failed or the output could not
+ *   be stored, leaving what was captured so far in @param buf.
+ */
+static int batch_drain(int fd, char **buf, size_t *len)
+{
+    char *grown;
+    ssize_t rc;
+
+    for (;;) {
+        grown = realloc(*buf, *len + BATCH_READ_SIZE + 1);
+        if (grown == NULL) {
+            return -1;
+        }
+        *buf = grown;
+        rc = read(fd, *buf + *len, BATCH_READ_SIZE);
+        if (rc > 0) {
+            *len += rc;
+            (*buf)[*len] = '\0';
+            continue;
+        }
+        if (rc == 0) {
+            return 0;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        return errno == EAGAIN ? 1 : -1;
+    }
+}
+
+/**
+ * Reap the command of @param slot if it exited, stamping its status and run time in
+ * @param result.
+ * @return false if waitpid() failed, which leaves the status at -1.
+ */
+static bool batch_reap(struct batch_slot *slot, struct exec_batch_result *result)
+{
+    pid_t rc;
     int status;
 
-    int fd;
-    fd = open(outputfile, O_WRONLY|O_CREAT, 644);
-    if (fd < 0) {
-        ret = false;
+    while ((rc = waitpid(slot->pid, &status, WNOHANG)) == -1 && errno == EINTR);
+    if (rc == 0) {
+        return true;
+    }
+
+    slot->reaped = true;
+    if (slot->pidfd != -1) {
+        close(slot->pidfd);
+        slot->pidfd = -1;
+    }
+    result->elapsed_ms = elapsed_ms_since(&slot->start);
+    if (rc == -1) {
+        return false;
+    }
+    result->status = status;
+    return true;
+}
+
+/**
+* Run the @param count commands of @param commands, each a NULL terminated argument list whose
+*   first element is the full path to execute as in do_exec(), with at most @param parallelism
+*   of them running at once.
+* Their stdout and stderr are captured through pipes, and their exits seen through pidfds, with
+*   a single poll() loop, so a command never blocks on a full pipe while the caller waits for
+*   another one, and a command closing its output early does not hold up the others.
+* @param results receives one struct exec_batch_result per command, in the order of commands,
+*   to be released with exec_batch_free_results().
+* @return true if every command was started, had its output captured and exited with status 0.
+*/
+bool do_exec_batch(char *const *const commands[], int count, int parallelism,
+                   struct exec_batch_result *results)
+{
+    struct batch_slot *slots;
+    struct pollfd *pfds;
+    struct exec_batch_result *result;
+    int running = 0;
+    int next = 0;
+    int nfds;
+    int timeout;
+    bool ret = true;
+    int rc;
+    int i;
+    int j;
+
+    if (parallelism < 1) {
+        parallelism = 1;
+    }
+    if (parallelism > count) {
+        parallelism = count;
+    }
+    memset(results, 0, count * sizeof(*results));
+    for (i = 0; i < count; i++) {
+        results[i].status = -1;
+    }
+
+    slots = calloc(parallelism, sizeof(*slots));
+    pfds = calloc(3 * parallelism, sizeof(*pfds));
+    if (count > 0 && (slots == NULL || pfds == NULL)) {
+        free(slots);
+        free(pfds);
+        return false;
     }
 
     fflush(stdout);
-    pid = fork();
-    if (pid == -1) {
-        ret = false;
-    } else if (pid == 0) {
-        if (dup2(fd, STDOUT_FILENO) < 0) {
-            exit(-1);
+    while (next < count || running > 0) {
+        // Fill the free slots, the running ones are always slots[0..running)
+        while (running < parallelism && next < count) {
+            slots[running].index = next;
+            if (batch_launch(commands[next], &slots[running])) {
+                running++;
+            } else {
+                ret = false;
+            }
+            next++;
+        }
+        if (running == 0) {
+            continue;
+        }
+
+        nfds = 0;
+        timeout = -1;
+        for (i = 0; i < running; i++) {
+            for (j = 0; j < 2; j++) {
+                if (slots[i].fds[j] != -1) {
+                    pfds[nfds].fd = slots[i].fds[j];
+                    pfds[nfds].events = POLLIN;
+                    nfds++;
+                }
+            }
+            if (slots[i].reaped) {
+                continue;
+            }
+            if (slots[i].pidfd != -1) {
+                pfds[nfds].fd = slots[i].pidfd;
+                pfds[nfds].events = POLLIN;
+                nfds++;
+            } else {
+                timeout = BATCH_REAP_POLL_MS;
+            }
+        }
+        if (poll(pfds, nfds, timeout) == -1 && errno != EINTR) {
+            ret = false;
+            break;
+        }
+
+        for (i = 0; i < running; ) {
+            result = &results[slots[i].index];
+            for (j = 0; j < 2; j++) {
+                if (slots[i].fds[j] == -1) {
+                    continue;
+                }
+                rc = batch_drain(slots[i].fds[j], j == 0 ? &result->out : &result->err,
+                                 j == 0 ? &result->out_len : &result->err_len);
+                if (rc != 1) {
+                    if (rc == -1) {
+                        ret = false;
+                    }
+                    close(slots[i].fds[j]);
+                    slots[i].fds[j] = -1;
+                }
+            }
+            if (!slots[i].reaped && !batch_reap(&slots[i], result)) {
+                ret = false;
+            }
+            if (!slots[i].reaped || slots[i].fds[0] != -1 || slots[i].fds[1] != -1) {
+                i++;
+                continue;
+            }
+
+            if (!WIFEXITED(result->status) || WEXITSTATUS(result->status) != 0) {
+                ret = false;
+            }
+            slots[i] = slots[--running];
         }
-        execv(command[0], command); // If this fails exit(-1) will run
-        exit(-1);
     }
-    
-    if (waitpid (pid, &status, 0) == -1)
-        ret = false;
 
-    if (fd > 0) {
-        close(fd);
+    // Only reached with commands left running if poll() failed
+    for (i = 0; i < running; i++) {
+        for (j = 0; j < 2; j++) {
+            if (slots[i].fds[j] != -1) {
+                close(slots[i].fds[j]);
+            }
+        }
+        if (slots[i].pidfd != -1) {
+            close(slots[i].pidfd);
+        }
+        if (!slots[i].reaped) {
+            while (waitpid(slots[i].pid, &results[slots[i].index].status, 0) == -1 && errno == EINTR);
+        }
     }
-    va_end(args);
 
+    free(slots);
+    free(pfds);
     return ret;
 }
+
+void exec_batch_free_results(struct exec_batch_result *results, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        free(results[i].out);
+        free(results[i].err);
+        results[i].out = NULL;
+        results[i].err = NULL;
+    }
+}
@@ -13,3 +13,23 @@ bool do_system(const char *command);
 bool do_exec(int count, ...);
 
 bool do_exec_redirect(const char *outputfile, int count, ...);
+
+/**
+ * Outcome of one command of do_exec_batch().  out and err hold everything the command wrote
+ * to stdout and stderr, NUL terminated, and are freed by exec_batch_free_results().
+ */
+struct exec_batch_result {
+    /* waitpid() status, -1 if the command could not be started */
+    int status;
+    char *out;
+    size_t out_len;
+    char *err;
+    size_t err_len;
+    /* Time from launch until the command exited */
+    double elapsed_ms;
+};
+
+bool do_exec_batch(char *const *const commands[], int count, int parallelism,
+                   struct exec_batch_result *results);
+
+void exec_batch_free_results(struct exec_batch_result *results, int count);
@@ -0,0 +1,69 @@
+#include "adaptive_mutex.h"
+#include "futex.h"
+#include <errno.h>
+
+void adaptive_mutex_init(struct adaptive_mutex *mutex)
+{
+    atomic_init(&mutex->state, 0);
+    atomic_init(&mutex->spin_limit, 0);
+    mutex->max_spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? ADAPTIVE_MUTEX_MAX_SPIN : 0;
+}
+
+static int try_acquire(struct adaptive_mutex *mutex)
+{
+    uint32_t unlocked = 0;
+
+    return atomic_compare_exchange_strong_explicit(&mutex->state, &unlocked, 1,
+                                                   memory_order_acquire, memory_order_relaxed);
+}
+
+int adaptive_mutex_trylock(struct adaptive_mutex *mutex)
+{
+    return try_acquire(mutex) ? 0 : EBUSY;
+}
+
+void adaptive_mutex_lock(struct adaptive_mutex *mutex)
+{
+    int limit;
+    int spun;
+    uint32_t state;
+
+    if (try_acquire(mutex)) {
+        return;
+    }
+
+    /* Spin up to twice the recent average, reading before each attempt to keep the line shared */
+    limit = atomic_load_explicit(&mutex->spin_limit, memory_order_relaxed) * 2 + 10;
+    if (limit > mutex->max_spin) {
+        limit = mutex->max_spin;
+    }
+    for (spun = 0; spun < limit; spun++) {
+        if (atomic_load_explicit(&mutex->state, memory_order_relaxed) == 0 && try_acquire(mutex)) {
+            atomic_fetch_add_explicit(&mutex->spin_limit,
+                                      (spun - atomic_load_explicit(&mutex->spin_limit, memory_order_relaxed)) / 8,
+                                      memory_order_relaxed);
+            return;
+        }
+        cpu_relax();
+    }
+    if (mutex->max_spin > 0) {
+        atomic_fetch_add_explicit(&mutex->spin_limit,
+                                  (limit - atomic_load_explicit(&mutex->spin_limit, memory_order_relaxed)) / 8,
+                                  memory_order_relaxed);
+    }
+
+    /* Mark the lock contended so the owner wakes us, then sleep until we take it from 0 */
+    state = atomic_exchange_explicit(&mutex->state, 2, memory_order_acquire);
+    while (state != 0) {
+        futex_wait(&mutex->state, 2);
+        state = atomic_exchange_explicit(&mutex->state, 2, memory_order_acquire);
+    }
+}
+
+void adaptive_mutex_unlock(struct adaptive_mutex *mutex)
+{
+    if (atomic_fetch_sub_explicit(&mutex->state, 1, memory_order_release) != 1) {
+        atomic_store_explicit(&mutex->state, 0, memory_order_release);
+        futex_wake(&mutex->state, 1);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef ADAPTIVE_MUTEX_H
+#define ADAPTIVE_MUTEX_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * Upper bound of the spin phase of adaptive_mutex_lock(), in polls of the lock word.
+ */
+#define ADAPTIVE_MUTEX_MAX_SPIN 1000
+
+/**
+ * A mutex which spins on the lock word for a while before parking the caller on a futex,
+ * so critical sections of a few hundred nanoseconds are not paid with two context switches.
+ *
+ * state is 0 when unlocked, 1 when locked and 2 when locked with possible sleepers, after
+ * Drepper's "Futexes Are Tricky".  spin_limit follows how long recent acquisitions had to spin,
+ * like glibc's PTHREAD_MUTEX_ADAPTIVE_NP, and stays 0 on a single CPU where spinning only
+ * delays the owner.
+ */
+struct adaptive_mutex {
+    _Atomic uint32_t state;
+    _Atomic int spin_limit;
+    int max_spin;
+};
+
+#define ADAPTIVE_MUTEX_INITIALIZER { 0, 0, ADAPTIVE_MUTEX_MAX_SPIN }
+
+/**
+* Initialize @param mutex unlocked, with no spinning when a single CPU is online.
+*/
+void adaptive_mutex_init(struct adaptive_mutex *mutex);
+
+void adaptive_mutex_lock(struct adaptive_mutex *mutex);
+
+/**
+* @return 0 if @param mutex was taken, EBUSY if it is held.
+*/
+int adaptive_mutex_trylock(struct adaptive_mutex *mutex);
+
+void adaptive_mutex_unlock(struct adaptive_mutex *mutex);
+
+#endif
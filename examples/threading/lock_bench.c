@@ -0,0 +1,302 @@
+/*
+ * Compares lock primitives under the wait/hold model of start_thread_obtaining_mutex(), scaled
+ * to many threads and nanosecond critical sections: every thread repeatedly waits
+ * wait_to_obtain_ns, takes the lock, holds it for wait_to_release_ns and releases it.
+ * Both waits are busy loops, sleeping would dwarf the sections being measured.
+ *
+ * Usage: lock_bench [-l pthread|adaptive|profiled|rwlock|wp_rwlock] [-t threads] [-n ops per thread]
+ *                   [-o wait_to_obtain_ns] [-h wait_to_release_ns] [-r read percent]
+ *
+ * Without -l every lock is run in turn.  -r only matters to the reader-writer locks, the
+ * mutexes take every read exclusively.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "adaptive_mutex.h"
+#include "profiled_mutex.h"
+#include "wp_rwlock.h"
+
+#define HIST_BUCKETS 32
+
+enum lock_kind {
+    LOCK_PTHREAD,
+    LOCK_ADAPTIVE,
+    LOCK_PROFILED,
+    LOCK_RWLOCK,
+    LOCK_WP_RWLOCK,
+    LOCK_KIND_NR,
+};
+
+static const char *lock_names[] = {
+    [LOCK_PTHREAD] =   "pthread",
+    [LOCK_ADAPTIVE] =  "adaptive",
+    [LOCK_PROFILED] =  "profiled",
+    [LOCK_RWLOCK] =    "rwlock",
+    [LOCK_WP_RWLOCK] = "wp_rwlock",
+};
+
+struct bench_config {
+    enum lock_kind kind;
+    int threads;
+    long ops;
+    long wait_to_obtain_ns;
+    long wait_to_release_ns;
+    int read_percent;
+};
+
+struct bench_thread {
+    pthread_t thread;
+    struct bench_config *config;
+    unsigned int seed;
+    long reads;
+    uint64_t acquire_hist[HIST_BUCKETS];
+};
+
+static pthread_mutex_t pthread_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct adaptive_mutex adaptive_lock;
+static struct profiled_mutex profiled_lock;
+static pthread_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static struct wp_rwlock wp_lock;
+
+/* Threads inside the lock, checked on every acquisition to catch a broken primitive */
+static _Atomic int readers_inside;
+static _Atomic int writers_inside;
+static _Atomic long violations;
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void busy_wait_ns(long ns)
+{
+    uint64_t end;
+
+    if (ns <= 0) {
+        return;
+    }
+    end = now_ns() + ns;
+    while (now_ns() < end);
+}
+
+static int hist_bucket(uint64_t ns)
+{
+    int bucket = ns < 2 ? 0 : 63 - __builtin_clzll(ns);
+
+    return bucket < HIST_BUCKETS ? bucket : HIST_BUCKETS - 1;
+}
+
+static void lock(enum lock_kind kind, bool read)
+{
+    switch (kind) {
+    case LOCK_PTHREAD:   pthread_mutex_lock(&pthread_lock); break;
+    case LOCK_ADAPTIVE:  adaptive_mutex_lock(&adaptive_lock); break;
+    case LOCK_PROFILED:  profiled_mutex_lock(&profiled_lock); break;
+    case LOCK_RWLOCK:
+        if (read) {
+            pthread_rwlock_rdlock(&rwlock);
+        } else {
+            pthread_rwlock_wrlock(&rwlock);
+        }
+        break;
+    default:
+        if (read) {
+            wp_rwlock_rdlock(&wp_lock);
+        } else {
+            wp_rwlock_wrlock(&wp_lock);
+        }
+        break;
+    }
+}
+
+static void unlock(enum lock_kind kind, bool read)
+{
+    switch (kind) {
+    case LOCK_PTHREAD:   pthread_mutex_unlock(&pthread_lock); break;
+    case LOCK_ADAPTIVE:  adaptive_mutex_unlock(&adaptive_lock); break;
+    case LOCK_PROFILED:  profiled_mutex_unlock(&profiled_lock); break;
+    case LOCK_RWLOCK:    pthread_rwlock_unlock(&rwlock); break;
+    default:
+        if (read) {
+            wp_rwlock_rdunlock(&wp_lock);
+        } else {
+            wp_rwlock_wrunlock(&wp_lock);
+        }
+        break;
+    }
+}
+
+static void* bench_thread_func(void* thread_param)
+{
+    struct bench_thread* t = (struct bench_thread *) thread_param;
+    struct bench_config* config = t->config;
+    bool shared = config->kind == LOCK_RWLOCK || config->kind == LOCK_WP_RWLOCK;
+    bool read;
+    uint64_t start;
+    long i;
+
+    for (i = 0; i < config->ops; i++) {
+        read = (int)(rand_r(&t->seed) % 100) < config->read_percent;
+        busy_wait_ns(config->wait_to_obtain_ns);
+
+        start = now_ns();
+        lock(config->kind, read);
+        t->acquire_hist[hist_bucket(now_ns() - start)]++;
+
+        if (read && shared) {
+            atomic_fetch_add(&readers_inside, 1);
+            if (atomic_load(&writers_inside) != 0) {
+                atomic_fetch_add(&violations, 1);
+            }
+            t->reads++;
+        } else if (atomic_fetch_add(&writers_inside, 1) != 0 || atomic_load(&readers_inside) != 0) {
+            atomic_fetch_add(&violations, 1);
+        }
+
+        busy_wait_ns(config->wait_to_release_ns);
+
+        if (read && shared) {
+            atomic_fetch_sub(&readers_inside, 1);
+        } else {
+            atomic_fetch_sub(&writers_inside, 1);
+        }
+        unlock(config->kind, read);
+    }
+    return thread_param;
+}
+
+static uint64_t percentile(const uint64_t *hist, int percent)
+{
+    uint64_t total = 0;
+    uint64_t seen = 0;
+    int i;
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        total += hist[i];
+    }
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist[i];
+        if (total > 0 && seen * 100 >= total * percent) {
+            return 2ULL << i;
+        }
+    }
+    return 0;
+}
+
+static int run(struct bench_config *config)
+{
+    struct bench_thread *threads;
+    uint64_t hist[HIST_BUCKETS] = { 0 };
+    uint64_t start;
+    double elapsed;
+    long ops;
+    long reads = 0;
+    int started;
+    int i;
+    int j;
+
+    threads = calloc(config->threads, sizeof(*threads));
+    if (threads == NULL) {
+        return -1;
+    }
+    atomic_store(&violations, 0);
+
+    start = now_ns();
+    for (started = 0; started < config->threads; started++) {
+        threads[started].config = config;
+        threads[started].seed = started + 1;
+        if (pthread_create(&threads[started].thread, NULL, bench_thread_func, &threads[started]) != 0) {
+            fprintf(stderr, "Failed to start thread %d\n", started);
+            break;
+        }
+    }
+    ops = (long)started * config->ops;
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i].thread, NULL);
+        reads += threads[i].reads;
+        for (j = 0; j < HIST_BUCKETS; j++) {
+            hist[j] += threads[i].acquire_hist[j];
+        }
+    }
+    elapsed = (now_ns() - start) / 1e9;
+
+    printf("%-10s threads=%-3d ops=%-9ld reads=%-9ld %10.1f ns/op %12.0f ops/s  acquire_ns p50<=%-8llu p99<=%-10llu violations=%ld\n",
+           lock_names[config->kind], started, ops, reads, ops ? elapsed * 1e9 / ops : 0.0,
+           ops / elapsed, (unsigned long long)percentile(hist, 50),
+           (unsigned long long)percentile(hist, 99), atomic_load(&violations));
+
+    free(threads);
+    return atomic_load(&violations) == 0 ? 0 : -1;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-l pthread|adaptive|profiled|rwlock|wp_rwlock] [-t threads] [-n ops per thread]\n"
+            "          [-o wait_to_obtain_ns] [-h wait_to_release_ns] [-r read percent]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_config config = {
+        .threads = 4,
+        .ops = 100000,
+        .wait_to_obtain_ns = 500,
+        .wait_to_release_ns = 200,
+        .read_percent = 90,
+    };
+    int only = -1;
+    int ret = 0;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "l:t:n:o:h:r:")) != -1) {
+        switch (opt) {
+        case 'l':
+            for (i = 0; i < LOCK_KIND_NR && strcmp(optarg, lock_names[i]) != 0; i++);
+            if (i == LOCK_KIND_NR) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            only = i;
+            break;
+        case 't': config.threads = atoi(optarg); break;
+        case 'n': config.ops = atol(optarg); break;
+        case 'o': config.wait_to_obtain_ns = atol(optarg); break;
+        case 'h': config.wait_to_release_ns = atol(optarg); break;
+        case 'r': config.read_percent = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (config.threads < 1 || config.ops < 1 || config.read_percent < 0 || config.read_percent > 100) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    adaptive_mutex_init(&adaptive_lock);
+    profiled_mutex_init(&profiled_lock, "lock_bench");
+    wp_rwlock_init(&wp_lock);
+
+    for (i = 0; i < LOCK_KIND_NR; i++) {
+        if (only != -1 && i != only) {
+            continue;
+        }
+        config.kind = i;
+        if (run(&config) != 0) {
+            ret = EXIT_FAILURE;
+        }
+    }
+
+    profiled_mutex_destroy(&profiled_lock);
+    return ret;
+}
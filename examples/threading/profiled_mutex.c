@@ -0,0 +1,316 @@
+#include "profiled_mutex.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+// Optional: use these functions to add debug or error prints to your application
+#define DEBUG_LOG(msg,...)
+//#define DEBUG_LOG(msg,...) printf("profiled_mutex: " msg "\n" , ##__VA_ARGS__)
+#define ERROR_LOG(msg,...) printf("profiled_mutex ERROR: " msg "\n" , ##__VA_ARGS__)
+
+/* Number of call sites printed per mutex by profiled_mutex_dump() */
+#define DUMP_TOP_SITES 5
+
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct profiled_mutex *registry;
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static int hist_bucket(uint64_t ns)
+{
+    int bucket;
+
+    if (ns < 2) {
+        return 0;
+    }
+    bucket = 63 - __builtin_clzll(ns);
+    return bucket < PROFILED_MUTEX_HIST_BUCKETS ? bucket : PROFILED_MUTEX_HIST_BUCKETS - 1;
+}
+
+static void update_max(atomic_uint_fast64_t *max, uint64_t value)
+{
+    uint_fast64_t current = atomic_load_explicit(max, memory_order_relaxed);
+
+    while (value > current &&
+           !atomic_compare_exchange_weak_explicit(max, &current, value,
+                                                  memory_order_relaxed, memory_order_relaxed));
+}
+
+static void count(atomic_uint_fast64_t *counter, uint64_t value)
+{
+    atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+}
+
+/**
+ * Find or claim the slot of file:line in the sites of mutex, returning NULL once they are all
+ * taken by other sites.  Claiming is serialized by registry_mutex, lookups are lock free.
+ */
+static struct profiled_mutex_site *find_site(struct profiled_mutex *mutex, const char *file, int line)
+{
+    struct profiled_mutex_site *site = NULL;
+    const char *site_file;
+    int i;
+
+    for (i = 0; i < PROFILED_MUTEX_SITES; i++) {
+        site_file = atomic_load_explicit(&mutex->sites[i].file, memory_order_acquire);
+        if (site_file == NULL) {
+            break;
+        }
+        if (site_file == file && mutex->sites[i].line == line) {
+            return &mutex->sites[i];
+        }
+    }
+    if (i == PROFILED_MUTEX_SITES) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&registry_mutex);
+    for (; i < PROFILED_MUTEX_SITES; i++) {
+        site = &mutex->sites[i];
+        site_file = atomic_load_explicit(&site->file, memory_order_relaxed);
+        if (site_file == NULL) {
+            site->line = line;
+            atomic_store_explicit(&site->file, file, memory_order_release);
+            break;
+        }
+        if (site_file == file && site->line == line) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_mutex);
+    return i < PROFILED_MUTEX_SITES ? site : NULL;
+}
+
+int profiled_mutex_init(struct profiled_mutex *mutex, const char *name)
+{
+    int rc;
+    int i;
+
+    memset(mutex, 0, sizeof(*mutex));
+    rc = pthread_mutex_init(&mutex->mutex, NULL);
+    if ( rc != 0 ) {
+        return rc;
+    }
+    mutex->name = name;
+    for (i = 0; i < PROFILED_MUTEX_SITES; i++) {
+        atomic_init(&mutex->sites[i].file, NULL);
+    }
+
+    pthread_mutex_lock(&registry_mutex);
+    mutex->next = registry;
+    registry = mutex;
+    pthread_mutex_unlock(&registry_mutex);
+    return 0;
+}
+
+int profiled_mutex_destroy(struct profiled_mutex *mutex)
+{
+    struct profiled_mutex **link;
+
+    pthread_mutex_lock(&registry_mutex);
+    for (link = &registry; *link != NULL; link = &(*link)->next) {
+        if (*link == mutex) {
+            *link = mutex->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_mutex);
+    return pthread_mutex_destroy(&mutex->mutex);
+}
+
+int profiled_mutex_lock_at(struct profiled_mutex *mutex, const char *file, int line)
+{
+    struct profiled_mutex_site *site;
+    uint64_t start;
+    uint64_t wait_ns = 0;
+    int rc;
+
+    rc = pthread_mutex_trylock(&mutex->mutex);
+    if ( rc == EBUSY ) {
+        start = now_ns();
+        rc = pthread_mutex_lock(&mutex->mutex);
+        if ( rc != 0 ) {
+            return rc;
+        }
+        mutex->acquired_ns = now_ns();
+        wait_ns = mutex->acquired_ns - start;
+
+        count(&mutex->contended, 1);
+        update_max(&mutex->max_wait_ns, wait_ns);
+        site = find_site(mutex, file, line);
+        if (site != NULL) {
+            count(&site->contended, 1);
+            count(&site->wait_ns, wait_ns);
+            update_max(&site->max_wait_ns, wait_ns);
+        }
+    } else if ( rc == 0 ) {
+        mutex->acquired_ns = now_ns();
+    } else {
+        return rc;
+    }
+
+    count(&mutex->acquisitions, 1);
+    count(&mutex->wait_hist[hist_bucket(wait_ns)], 1);
+    return 0;
+}
+
+int profiled_mutex_unlock(struct profiled_mutex *mutex)
+{
+    uint64_t hold_ns = now_ns() - mutex->acquired_ns;
+
+    count(&mutex->hold_hist[hist_bucket(hold_ns)], 1);
+    update_max(&mutex->max_hold_ns, hold_ns);
+    return pthread_mutex_unlock(&mutex->mutex);
+}
+
+static void dump_line(int fd, const char *fmt, ...)
+{
+    char line[256];
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+
+    if (fd == -1) {
+        syslog(LOG_INFO, "%s", line);
+    } else {
+        dprintf(fd, "%s\n", line);
+    }
+}
+
+/**
+ * @return the upper bound in ns of the bucket holding the percent percentile of hist
+ */
+static uint64_t percentile(atomic_uint_fast64_t *hist, int percent)
+{
+    uint64_t snapshot[PROFILED_MUTEX_HIST_BUCKETS];
+    uint64_t total = 0;
+    uint64_t seen = 0;
+    int i;
+
+    for (i = 0; i < PROFILED_MUTEX_HIST_BUCKETS; i++) {
+        snapshot[i] = atomic_load_explicit(&hist[i], memory_order_relaxed);
+        total += snapshot[i];
+    }
+    for (i = 0; i < PROFILED_MUTEX_HIST_BUCKETS; i++) {
+        seen += snapshot[i];
+        if (total > 0 && seen * 100 >= total * percent) {
+            return 2ULL << i;
+        }
+    }
+    return 0;
+}
+
+static void dump_mutex(int fd, struct profiled_mutex *mutex)
+{
+    struct profiled_mutex_site *top[DUMP_TOP_SITES] = { NULL };
+    uint64_t acquisitions = atomic_load_explicit(&mutex->acquisitions, memory_order_relaxed);
+    uint64_t contended = atomic_load_explicit(&mutex->contended, memory_order_relaxed);
+    struct profiled_mutex_site *site;
+    int i;
+    int j;
+
+    dump_line(fd, "mutex %s: acquisitions %llu contended %llu (%.1f%%)", mutex->name,
+              (unsigned long long)acquisitions, (unsigned long long)contended,
+              acquisitions ? 100.0 * contended / acquisitions : 0.0);
+    dump_line(fd, "  wait_ns p50<=%llu p99<=%llu max %llu",
+              (unsigned long long)percentile(mutex->wait_hist, 50),
+              (unsigned long long)percentile(mutex->wait_hist, 99),
+              (unsigned long long)atomic_load_explicit(&mutex->max_wait_ns, memory_order_relaxed));
+    dump_line(fd, "  hold_ns p50<=%llu p99<=%llu max %llu",
+              (unsigned long long)percentile(mutex->hold_hist, 50),
+              (unsigned long long)percentile(mutex->hold_hist, 99),
+              (unsigned long long)atomic_load_explicit(&mutex->max_hold_ns, memory_order_relaxed));
+
+    /* Insertion sort of the sites by total wait, keeping the first DUMP_TOP_SITES */
+    for (i = 0; i < PROFILED_MUTEX_SITES; i++) {
+        site = &mutex->sites[i];
+        if (atomic_load_explicit(&site->file, memory_order_acquire) == NULL) {
+            break;
+        }
+        for (j = DUMP_TOP_SITES - 1; j >= 0; j--) {
+            if (top[j] != NULL && atomic_load_explicit(&top[j]->wait_ns, memory_order_relaxed) >=
+                                  atomic_load_explicit(&site->wait_ns, memory_order_relaxed)) {
+                break;
+            }
+            if (j + 1 < DUMP_TOP_SITES) {
+                top[j + 1] = top[j];
+            }
+        }
+        if (j + 1 < DUMP_TOP_SITES) {
+            top[j + 1] = site;
+        }
+    }
+    for (i = 0; i < DUMP_TOP_SITES && top[i] != NULL; i++) {
+        dump_line(fd, "  site %s:%d contended %llu wait_ns total %llu max %llu",
+                  atomic_load_explicit(&top[i]->file, memory_order_relaxed), top[i]->line,
+                  (unsigned long long)atomic_load_explicit(&top[i]->contended, memory_order_relaxed),
+                  (unsigned long long)atomic_load_explicit(&top[i]->wait_ns, memory_order_relaxed),
+                  (unsigned long long)atomic_load_explicit(&top[i]->max_wait_ns, memory_order_relaxed));
+    }
+}
+
+void profiled_mutex_dump(int fd)
+{
+    struct profiled_mutex *mutex;
+
+    pthread_mutex_lock(&registry_mutex);
+    for (mutex = registry; mutex != NULL; mutex = mutex->next) {
+        dump_mutex(fd, mutex);
+    }
+    pthread_mutex_unlock(&registry_mutex);
+}
+
+struct dump_thread_args {
+    sigset_t set;
+    int fd;
+};
+
+static struct dump_thread_args dump_args;
+
+static void* dump_thread(void* thread_param)
+{
+    struct dump_thread_args* args = (struct dump_thread_args *) thread_param;
+    int signum;
+
+    while (sigwait(&args->set, &signum) == 0) {
+        DEBUG_LOG("Dumping on signal %d", signum);
+        profiled_mutex_dump(args->fd);
+    }
+    return thread_param;
+}
+
+int profiled_mutex_dump_on_signal(int signum, int fd)
+{
+    pthread_t thread;
+    int rc;
+
+    sigemptyset(&dump_args.set);
+    sigaddset(&dump_args.set, signum);
+    dump_args.fd = fd;
+
+    rc = pthread_sigmask(SIG_BLOCK, &dump_args.set, NULL);
+    if ( rc != 0 ) {
+        ERROR_LOG("Failed to block signal %d: %d", signum, rc);
+        return rc;
+    }
+    rc = pthread_create(&thread, NULL, dump_thread, &dump_args);
+    if ( rc != 0 ) {
+        ERROR_LOG("Failed to start dump thread: %d", rc);
+        pthread_sigmask(SIG_UNBLOCK, &dump_args.set, NULL);
+        return rc;
+    }
+    pthread_detach(thread);
+    return 0;
+}
@@ -0,0 +1,103 @@
+#ifndef PROFILED_MUTEX_H
+#define PROFILED_MUTEX_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/**
+ * Number of log2 buckets of the wait and hold time histograms, bucket i counting durations
+ * below 2^(i+1) ns and the last one everything longer.
+ */
+#define PROFILED_MUTEX_HIST_BUCKETS 32
+
+/**
+ * Number of distinct call sites tracked per mutex, contention from further sites is
+ * accounted to the mutex only.
+ */
+#define PROFILED_MUTEX_SITES 16
+
+/**
+ * A profiled_mutex_lock() call site which had to wait for the mutex.
+ * file is published last, a slot with file == NULL is free.
+ */
+struct profiled_mutex_site {
+    _Atomic(const char *) file;
+    int line;
+    atomic_uint_fast64_t contended;
+    atomic_uint_fast64_t wait_ns;
+    atomic_uint_fast64_t max_wait_ns;
+};
+
+/**
+ * A pthread_mutex_t recording how often it is taken, how long callers wait for it and how long
+ * they hold it.  An uncontended lock costs one pthread_mutex_trylock() and two clock reads more
+ * than a plain pthread_mutex_lock(), cheap enough to leave on in production.
+ */
+struct profiled_mutex {
+    pthread_mutex_t mutex;
+    const char *name;
+
+    atomic_uint_fast64_t acquisitions;
+    atomic_uint_fast64_t contended;
+    atomic_uint_fast64_t wait_hist[PROFILED_MUTEX_HIST_BUCKETS];
+    atomic_uint_fast64_t hold_hist[PROFILED_MUTEX_HIST_BUCKETS];
+    atomic_uint_fast64_t max_wait_ns;
+    atomic_uint_fast64_t max_hold_ns;
+    /**
+     * Time the current owner took the mutex, only accessed with the mutex held
+     */
+    uint64_t acquired_ns;
+
+    struct profiled_mutex_site sites[PROFILED_MUTEX_SITES];
+
+    /**
+     * Registry of every initialized mutex, walked by profiled_mutex_dump()
+     */
+    struct profiled_mutex *next;
+};
+
+/**
+* Initialize @param mutex with default attributes and register it as @param name, which must
+* outlive the mutex.
+* @return 0 on success or the error number returned by pthread_mutex_init.
+*/
+int profiled_mutex_init(struct profiled_mutex *mutex, const char *name);
+
+/**
+* Unregister and destroy @param mutex, which must be unlocked.
+* @return 0 on success or the error number returned by pthread_mutex_destroy.
+*/
+int profiled_mutex_destroy(struct profiled_mutex *mutex);
+
+/**
+* Lock @param mutex, accounting any wait to the calling file and line.
+* @return 0 on success or the error number returned by pthread_mutex_lock.
+*/
+#define profiled_mutex_lock(mutex) profiled_mutex_lock_at(mutex, __FILE__, __LINE__)
+
+int profiled_mutex_lock_at(struct profiled_mutex *mutex, const char *file, int line);
+
+/**
+* Unlock @param mutex, accounting the time it was held.
+* @return 0 on success or the error number returned by pthread_mutex_unlock.
+*/
+int profiled_mutex_unlock(struct profiled_mutex *mutex);
+
+/**
+* Write the statistics of every registered mutex to @param fd, or to syslog when fd is -1:
+* acquisition and contention counts, wait and hold percentiles, and the call sites which
+* waited longest.  Safe to call while the mutexes are in use.
+*/
+void profiled_mutex_dump(int fd);
+
+/**
+* Start a thread which calls profiled_mutex_dump(@param fd) whenever @param signum is received.
+* signum is blocked in the calling thread, so this must be called before other threads are
+* created for them to inherit the mask and leave the signal to the dump thread.
+* @return 0 on success or an error number.
+*/
+int profiled_mutex_dump_on_signal(int signum, int fd);
+
+#endif
@@ -0,0 +1,583 @@
+#include "thread_pool.h"
+#include "adaptive_mutex.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Optional: use these functions to add debug or error prints to your application
+#define DEBUG_LOG(msg,...)
+//#define DEBUG_LOG(msg,...) printf("thread_pool: " msg "\n" , ##__VA_ARGS__)
+#define ERROR_LOG(msg,...) printf("thread_pool ERROR: " msg "\n" , ##__VA_ARGS__)
+
+/* Initial number of slots of a worker deque, doubled whenever it fills up */
+#define DEQUE_INITIAL_SIZE 64
+
+/**
+ * A task and its completion.  While queued or timed it is referenced from exactly one deque
+ * slot or timer list position.
+ */
+struct thread_pool_future {
+    thread_pool_fn fn;
+    void *arg;
+    uint64_t period_ns;
+    /**
+     * Time the task is next due, and the next task of the timer list, under timer_mutex
+     */
+    uint64_t due_ns;
+    struct thread_pool_future *next;
+
+    atomic_bool cancelled;
+    atomic_int refs;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool done;
+    void *result;
+};
+
+/**
+ * Tasks of one worker.  The owner pushes and pops at bottom, thieves take from top, and both
+ * counters run freely and are masked into tasks.
+ */
+struct worker_deque {
+    struct adaptive_mutex lock;
+    struct thread_pool_future **tasks;
+    uint32_t mask;
+    uint32_t top;
+    uint32_t bottom;
+};
+
+struct worker {
+    struct thread_pool *pool;
+    pthread_t thread;
+    struct worker_deque deque;
+    unsigned int seed;
+};
+
+struct thread_pool {
+    struct worker *workers;
+    int nworkers;
+    atomic_uint next_worker;
+
+    /**
+     * Tasks pushed on a deque and not yet taken.  Briefly negative when a task is taken before
+     * its submitter counted it.
+     */
+    atomic_long pending;
+    atomic_int idle;
+    atomic_bool stopping;
+    pthread_mutex_t idle_mutex;
+    pthread_cond_t idle_cond;
+
+    pthread_t timer_thread;
+    pthread_mutex_t timer_mutex;
+    pthread_cond_t timer_cond;
+    /**
+     * Delayed and periodic tasks sorted by due_ns
+     */
+    struct thread_pool_future *timers;
+    bool timer_stop;
+};
+
+/* Worker running on the calling thread, so tasks it submits stay on its own deque */
+static __thread struct worker *current_worker;
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/*               FUTURES               */
+
+static struct thread_pool_future *future_alloc(thread_pool_fn fn, void *arg,
+                                               struct thread_pool_future **future_rtn)
+{
+    struct thread_pool_future *future = calloc(1, sizeof(*future));
+
+    if (future == NULL) {
+        return NULL;
+    }
+    future->fn = fn;
+    future->arg = arg;
+    atomic_init(&future->cancelled, false);
+    atomic_init(&future->refs, future_rtn != NULL ? 2 : 1);
+    pthread_mutex_init(&future->mutex, NULL);
+    pthread_cond_init(&future->cond, NULL);
+    if (future_rtn != NULL) {
+        *future_rtn = future;
+    }
+    return future;
+}
+
+void thread_pool_future_release(struct thread_pool_future *future)
+{
+    if (atomic_fetch_sub(&future->refs, 1) == 1) {
+        pthread_cond_destroy(&future->cond);
+        pthread_mutex_destroy(&future->mutex);
+        free(future);
+    }
+}
+
+/**
+ * Record result, wake the waiters and drop the pool's reference
+ */
+static void future_complete(struct thread_pool_future *future, void *result)
+{
+    pthread_mutex_lock(&future->mutex);
+    future->result = result;
+    future->done = true;
+    pthread_cond_broadcast(&future->cond);
+    pthread_mutex_unlock(&future->mutex);
+    thread_pool_future_release(future);
+}
+
+void *thread_pool_future_wait(struct thread_pool_future *future)
+{
+    void *result;
+
+    pthread_mutex_lock(&future->mutex);
+    while (!future->done) {
+        pthread_cond_wait(&future->cond, &future->mutex);
+    }
+    result = future->result;
+    pthread_mutex_unlock(&future->mutex);
+    return result;
+}
+
+bool thread_pool_future_done(struct thread_pool_future *future)
+{
+    bool done;
+
+    pthread_mutex_lock(&future->mutex);
+    done = future->done;
+    pthread_mutex_unlock(&future->mutex);
+    return done;
+}
+
+/*               DEQUES               */
+
+static int deque_init(struct worker_deque *deque)
+{
+    adaptive_mutex_init(&deque->lock);
+    deque->tasks = calloc(DEQUE_INITIAL_SIZE, sizeof(*deque->tasks));
+    deque->mask = DEQUE_INITIAL_SIZE - 1;
+    deque->top = 0;
+    deque->bottom = 0;
+    return deque->tasks != NULL ? 0 : ENOMEM;
+}
+
+static int deque_push(struct worker_deque *deque, struct thread_pool_future *task)
+{
+    struct thread_pool_future **tasks;
+    uint32_t size;
+    uint32_t i;
+    int ret = 0;
+
+    adaptive_mutex_lock(&deque->lock);
+    size = deque->mask + 1;
+    if (deque->bottom - deque->top == size) {
+        tasks = malloc(2 * size * sizeof(*tasks));
+        if (tasks == NULL) {
+            ret = ENOMEM;
+            goto exit;
+        }
+        for (i = deque->top; i != deque->bottom; i++) {
+            tasks[i & (2 * size - 1)] = deque->tasks[i & deque->mask];
+        }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->mask = 2 * size - 1;
+    }
+    deque->tasks[deque->bottom++ & deque->mask] = task;
+
+exit:
+    adaptive_mutex_unlock(&deque->lock);
+    return ret;
+}
+
+static struct thread_pool_future *deque_pop(struct worker_deque *deque)
+{
+    struct thread_pool_future *task = NULL;
+
+    adaptive_mutex_lock(&deque->lock);
+    if (deque->bottom != deque->top) {
+        task = deque->tasks[--deque->bottom & deque->mask];
+    }
+    adaptive_mutex_unlock(&deque->lock);
+    return task;
+}
+
+/**
+ * Take the oldest task of deque.  Unless wait is set, a deque whose lock is held is skipped and
+ * *contended is set instead.
+ */
+static struct thread_pool_future *deque_steal(struct worker_deque *deque, bool wait, bool *contended)
+{
+    struct thread_pool_future *task = NULL;
+
+    if (wait) {
+        adaptive_mutex_lock(&deque->lock);
+    } else if (adaptive_mutex_trylock(&deque->lock) != 0) {
+        *contended = true;
+        return NULL;
+    }
+    if (deque->bottom != deque->top) {
+        task = deque->tasks[deque->top++ & deque->mask];
+    }
+    adaptive_mutex_unlock(&deque->lock);
+    return task;
+}
+
+/*               WORKERS               */
+
+static int enqueue(struct thread_pool *pool, struct thread_pool_future *task)
+{
+    struct worker *worker = current_worker;
+    int ret;
+
+    if (worker == NULL || worker->pool != pool) {
+        worker = &pool->workers[atomic_fetch_add(&pool->next_worker, 1) % pool->nworkers];
+    }
+    ret = deque_push(&worker->deque, task);
+    if (ret != 0) {
+        return ret;
+    }
+
+    atomic_fetch_add(&pool->pending, 1);
+    if (atomic_load(&pool->idle) > 0) {
+        pthread_mutex_lock(&pool->idle_mutex);
+        pthread_cond_signal(&pool->idle_cond);
+        pthread_mutex_unlock(&pool->idle_mutex);
+    }
+    return 0;
+}
+
+/**
+ * Steal from the other workers in turn, starting at a random one
+ */
+static struct thread_pool_future *steal_task(struct worker *worker, bool wait, bool *contended)
+{
+    struct thread_pool *pool = worker->pool;
+    struct thread_pool_future *task = NULL;
+    int start = rand_r(&worker->seed) % pool->nworkers;
+    int i;
+
+    for (i = 0; i < pool->nworkers && task == NULL; i++) {
+        struct worker *victim = &pool->workers[(start + i) % pool->nworkers];
+
+        if (victim != worker) {
+            task = deque_steal(&victim->deque, wait, contended);
+        }
+    }
+    return task;
+}
+
+static struct thread_pool_future *find_task(struct worker *worker)
+{
+    struct thread_pool *pool = worker->pool;
+    struct thread_pool_future *task;
+    bool contended = false;
+
+    task = deque_pop(&worker->deque);
+    if (task == NULL) {
+        task = steal_task(worker, false, &contended);
+    }
+    /* Wait for the busy victims rather than return empty handed: worker_thread only sleeps once
+       pending drops to zero, so a thief losing every trylock would spin until the owners are done */
+    if (task == NULL && contended) {
+        task = steal_task(worker, true, &contended);
+    }
+    if (task != NULL) {
+        atomic_fetch_sub(&pool->pending, 1);
+    }
+    return task;
+}
+
+static void timer_insert(struct thread_pool *pool, struct thread_pool_future *task);
+
+static void run_task(struct thread_pool *pool, struct thread_pool_future *task)
+{
+    void *result;
+    uint64_t now;
+
+    if (atomic_load(&task->cancelled)) {
+        future_complete(task, NULL);
+        return;
+    }
+    result = task->fn(task->arg);
+    if (task->period_ns == 0) {
+        future_complete(task, result);
+        return;
+    }
+
+    /* Periodic: due again one period after the last due time, or now if that has passed */
+    pthread_mutex_lock(&pool->timer_mutex);
+    if (atomic_load(&task->cancelled) || pool->timer_stop) {
+        pthread_mutex_unlock(&pool->timer_mutex);
+        future_complete(task, NULL);
+        return;
+    }
+    now = now_ns();
+    task->due_ns += task->period_ns;
+    if (task->due_ns < now) {
+        task->due_ns = now;
+    }
+    timer_insert(pool, task);
+    pthread_mutex_unlock(&pool->timer_mutex);
+}
+
+static void* worker_thread(void* thread_param)
+{
+    struct worker* worker = (struct worker *) thread_param;
+    struct thread_pool *pool = worker->pool;
+    struct thread_pool_future *task;
+    bool exit = false;
+
+    current_worker = worker;
+    while (!exit) {
+        task = find_task(worker);
+        if (task != NULL) {
+            run_task(pool, task);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->idle_mutex);
+        atomic_fetch_add(&pool->idle, 1);
+        while (atomic_load(&pool->pending) <= 0 && !atomic_load(&pool->stopping)) {
+            pthread_cond_wait(&pool->idle_cond, &pool->idle_mutex);
+        }
+        atomic_fetch_sub(&pool->idle, 1);
+        exit = atomic_load(&pool->pending) <= 0 && atomic_load(&pool->stopping);
+        pthread_mutex_unlock(&pool->idle_mutex);
+    }
+    DEBUG_LOG("Worker exiting");
+    return thread_param;
+}
+
+/*               TIMERS               */
+
+/**
+ * Insert task in due order, waking the timer thread if it is now first.  Caller holds timer_mutex.
+ */
+static void timer_insert(struct thread_pool *pool, struct thread_pool_future *task)
+{
+    struct thread_pool_future **link = &pool->timers;
+
+    while (*link != NULL && (*link)->due_ns <= task->due_ns) {
+        link = &(*link)->next;
+    }
+    task->next = *link;
+    *link = task;
+    if (link == &pool->timers) {
+        pthread_cond_signal(&pool->timer_cond);
+    }
+}
+
+static void* timer_thread(void* thread_param)
+{
+    struct thread_pool* pool = (struct thread_pool *) thread_param;
+    struct thread_pool_future *task;
+    struct timespec due;
+
+    pthread_mutex_lock(&pool->timer_mutex);
+    while (!pool->timer_stop) {
+        task = pool->timers;
+        if (task == NULL) {
+            pthread_cond_wait(&pool->timer_cond, &pool->timer_mutex);
+        } else if (task->due_ns <= now_ns()) {
+            pool->timers = task->next;
+            pthread_mutex_unlock(&pool->timer_mutex);
+            if (enqueue(pool, task) != 0) {
+                ERROR_LOG("Failed to queue timed task");
+                future_complete(task, NULL);
+            }
+            pthread_mutex_lock(&pool->timer_mutex);
+        } else {
+            due.tv_sec = task->due_ns / 1000000000ULL;
+            due.tv_nsec = task->due_ns % 1000000000ULL;
+            pthread_cond_timedwait(&pool->timer_cond, &pool->timer_mutex, &due);
+        }
+    }
+
+    /* Whatever is still timed will never run */
+    while ((task = pool->timers) != NULL) {
+        pool->timers = task->next;
+        future_complete(task, NULL);
+    }
+    pthread_mutex_unlock(&pool->timer_mutex);
+    return thread_param;
+}
+
+int thread_pool_schedule(struct thread_pool *pool, thread_pool_fn fn, void *arg,
+                         unsigned int delay_ms, unsigned int period_ms,
+                         struct thread_pool_future **future_rtn)
+{
+    struct thread_pool_future *task = future_alloc(fn, arg, future_rtn);
+
+    if (task == NULL) {
+        return ENOMEM;
+    }
+    task->period_ns = period_ms * 1000000ULL;
+    task->due_ns = now_ns() + delay_ms * 1000000ULL;
+
+    pthread_mutex_lock(&pool->timer_mutex);
+    timer_insert(pool, task);
+    pthread_mutex_unlock(&pool->timer_mutex);
+    return 0;
+}
+
+void thread_pool_cancel(struct thread_pool *pool, struct thread_pool_future *future)
+{
+    struct thread_pool_future **link;
+    bool found = false;
+
+    /* Under timer_mutex so a periodic task finishing a run cannot re-arm behind our back */
+    pthread_mutex_lock(&pool->timer_mutex);
+    atomic_store(&future->cancelled, true);
+    for (link = &pool->timers; *link != NULL; link = &(*link)->next) {
+        if (*link == future) {
+            *link = future->next;
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool->timer_mutex);
+
+    if (found) {
+        future_complete(future, NULL);
+    }
+}
+
+/*               POOL               */
+
+int thread_pool_submit(struct thread_pool *pool, thread_pool_fn fn, void *arg,
+                       struct thread_pool_future **future_rtn)
+{
+    struct thread_pool_future *task = future_alloc(fn, arg, future_rtn);
+    int ret;
+
+    if (task == NULL) {
+        return ENOMEM;
+    }
+    ret = enqueue(pool, task);
+    if (ret != 0) {
+        if (future_rtn != NULL) {
+            *future_rtn = NULL;
+            thread_pool_future_release(task);
+        }
+        thread_pool_future_release(task);
+    }
+    return ret;
+}
+
+struct thread_pool *thread_pool_create(int workers)
+{
+    struct thread_pool *pool;
+    pthread_condattr_t attr;
+    int started = 0;
+    int rc;
+    int i;
+
+    if (workers < 1) {
+        errno = EINVAL;
+        return NULL;
+    }
+    pool = calloc(1, sizeof(*pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->workers = calloc(workers, sizeof(*pool->workers));
+    if (pool->workers == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pool->nworkers = workers;
+    atomic_init(&pool->next_worker, 0);
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->idle, 0);
+    atomic_init(&pool->stopping, false);
+    pthread_mutex_init(&pool->idle_mutex, NULL);
+    pthread_cond_init(&pool->idle_cond, NULL);
+    pthread_mutex_init(&pool->timer_mutex, NULL);
+    /* Due times are CLOCK_MONOTONIC, so wall clock changes do not move them */
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&pool->timer_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    for (i = 0; i < workers; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].seed = i + 1;
+        rc = deque_init(&pool->workers[i].deque);
+        if ( rc != 0 ) {
+            goto fail;
+        }
+    }
+    for (started = 0; started < workers; started++) {
+        rc = pthread_create(&pool->workers[started].thread, NULL, worker_thread, &pool->workers[started]);
+        if ( rc != 0 ) {
+            ERROR_LOG("Failed to start worker %d: %d", started, rc);
+            goto fail;
+        }
+    }
+    rc = pthread_create(&pool->timer_thread, NULL, timer_thread, pool);
+    if ( rc == 0 ) {
+        return pool;
+    }
+    ERROR_LOG("Failed to start timer thread: %d", rc);
+
+fail:
+    atomic_store(&pool->stopping, true);
+    pthread_mutex_lock(&pool->idle_mutex);
+    pthread_cond_broadcast(&pool->idle_cond);
+    pthread_mutex_unlock(&pool->idle_mutex);
+    for (i = 0; i < started; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    for (i = 0; i < workers; i++) {
+        free(pool->workers[i].deque.tasks);
+    }
+    pthread_cond_destroy(&pool->timer_cond);
+    pthread_mutex_destroy(&pool->timer_mutex);
+    pthread_cond_destroy(&pool->idle_cond);
+    pthread_mutex_destroy(&pool->idle_mutex);
+    free(pool->workers);
+    free(pool);
+    errno = rc;
+    return NULL;
+}
+
+void thread_pool_destroy(struct thread_pool *pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->timer_mutex);
+    pool->timer_stop = true;
+    pthread_cond_signal(&pool->timer_cond);
+    pthread_mutex_unlock(&pool->timer_mutex);
+    pthread_join(pool->timer_thread, NULL);
+
+    /* Workers drain the deques before they notice stopping */
+    atomic_store(&pool->stopping, true);
+    pthread_mutex_lock(&pool->idle_mutex);
+    pthread_cond_broadcast(&pool->idle_cond);
+    pthread_mutex_unlock(&pool->idle_mutex);
+    for (i = 0; i < pool->nworkers; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        free(pool->workers[i].deque.tasks);
+    }
+
+    pthread_cond_destroy(&pool->timer_cond);
+    pthread_mutex_destroy(&pool->timer_mutex);
+    pthread_cond_destroy(&pool->idle_cond);
+    pthread_mutex_destroy(&pool->idle_mutex);
+    free(pool->workers);
+    free(pool);
+}
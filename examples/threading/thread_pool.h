@@ -0,0 +1,72 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdbool.h>
+
+/**
+ * A task, returning the value handed to thread_pool_future_wait().
+ */
+typedef void *(*thread_pool_fn)(void *arg);
+
+/**
+ * A fixed set of worker threads, each owning a deque of tasks: a worker takes its newest task
+ * first and, once empty, steals the oldest task of another worker.  Tasks submitted from a
+ * worker stay on its deque, others are spread round robin.  A timer thread holds delayed and
+ * periodic tasks until they are due and then queues them like any other task.
+ */
+struct thread_pool;
+
+/**
+ * Completion of one submitted task.  The pool and the caller each hold a reference, the
+ * caller drops its own with thread_pool_future_release().
+ */
+struct thread_pool_future;
+
+/**
+* Start a pool of @param workers threads, plus the timer thread.
+* @return the pool, or NULL with errno set.
+*/
+struct thread_pool *thread_pool_create(int workers);
+
+/**
+* Cancel every delayed and periodic task, run the tasks already queued, then stop and free
+* @param pool.  No task may be submitted once this is called.
+*/
+void thread_pool_destroy(struct thread_pool *pool);
+
+/**
+* Queue @param fn(@param arg) to run on a worker.
+* @param future_rtn receives a future of the task when not NULL.
+* @return 0 on success, ENOMEM if the task could not be allocated.
+*/
+int thread_pool_submit(struct thread_pool *pool, thread_pool_fn fn, void *arg,
+                       struct thread_pool_future **future_rtn);
+
+/**
+* Queue @param fn(@param arg) to run @param delay_ms from now and, when @param period_ms is
+* nonzero, every period_ms after that.  A periodic run which overruns its period is not
+* overlapped by the next one, which starts as soon as it returns.
+* The future of a periodic task completes, with NULL, only once it is cancelled.
+* @return 0 on success, ENOMEM if the task could not be allocated.
+*/
+int thread_pool_schedule(struct thread_pool *pool, thread_pool_fn fn, void *arg,
+                         unsigned int delay_ms, unsigned int period_ms,
+                         struct thread_pool_future **future_rtn);
+
+/**
+* Stop @param future's task from running again.  A task already running finishes first.
+* A cancelled task which never ran completes with NULL.
+*/
+void thread_pool_cancel(struct thread_pool *pool, struct thread_pool_future *future);
+
+/**
+* Block until @param future's task has completed.
+* @return the value returned by the task, NULL if it was cancelled first.
+*/
+void *thread_pool_future_wait(struct thread_pool_future *future);
+
+bool thread_pool_future_done(struct thread_pool_future *future);
+
+void thread_pool_future_release(struct thread_pool_future *future);
+
+#endif
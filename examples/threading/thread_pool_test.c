@@ -0,0 +1,167 @@
+/*
+ * Exercises thread_pool: futures, tasks submitted from a worker and stolen by the others,
+ * delayed and periodic tasks with cancellation, and destroying a pool with tasks still timed.
+ * Prints one line per check and exits nonzero on the first failure.
+ *
+ * Usage: thread_pool_test [workers], at least 2 so a blocked worker's tasks can be stolen
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+
+#define TEST_TASKS 1000
+#define TEST_CHILDREN 64
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        exit(EXIT_FAILURE); \
+    } \
+} while (0)
+
+static struct thread_pool *pool;
+static atomic_long counter;
+static atomic_int ticks;
+
+static uint64_t now_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void *count_task(void *arg)
+{
+    atomic_fetch_add(&counter, 1);
+    return arg;
+}
+
+static void *tick_task(void *arg)
+{
+    atomic_fetch_add(&ticks, 1);
+    return arg;
+}
+
+/*
+ * Submitted from a worker, the children land on that worker's own deque.  It then blocks on
+ * them, so they only complete if the other workers steal them.
+ */
+static void *parent_task(void *arg)
+{
+    struct thread_pool_future *children[TEST_CHILDREN];
+    intptr_t sum = 0;
+    intptr_t i;
+
+    (void)arg;
+    for (i = 0; i < TEST_CHILDREN; i++) {
+        CHECK(thread_pool_submit(pool, count_task, (void *)i, &children[i]) == 0);
+    }
+    for (i = 0; i < TEST_CHILDREN; i++) {
+        sum += (intptr_t)thread_pool_future_wait(children[i]);
+        thread_pool_future_release(children[i]);
+    }
+    return (void *)sum;
+}
+
+static void test_futures(void)
+{
+    struct thread_pool_future *futures[TEST_TASKS];
+    intptr_t i;
+
+    for (i = 0; i < TEST_TASKS; i++) {
+        CHECK(thread_pool_submit(pool, count_task, (void *)i, &futures[i]) == 0);
+    }
+    for (i = 0; i < TEST_TASKS; i++) {
+        CHECK(thread_pool_future_wait(futures[i]) == (void *)i);
+        CHECK(thread_pool_future_done(futures[i]));
+        thread_pool_future_release(futures[i]);
+    }
+    printf("futures: %d tasks returned their results\n", TEST_TASKS);
+}
+
+static void test_stealing(void)
+{
+    struct thread_pool_future *parent;
+
+    CHECK(thread_pool_submit(pool, parent_task, NULL, &parent) == 0);
+    CHECK(thread_pool_future_wait(parent) == (void *)(intptr_t)(TEST_CHILDREN * (TEST_CHILDREN - 1) / 2));
+    thread_pool_future_release(parent);
+    printf("stealing: %d children of a blocked worker completed\n", TEST_CHILDREN);
+}
+
+static void test_timed(void)
+{
+    struct thread_pool_future *delayed;
+    struct thread_pool_future *periodic;
+    uint64_t start;
+    uint64_t elapsed;
+    int seen;
+
+    start = now_ms();
+    CHECK(thread_pool_schedule(pool, count_task, (void *)7, 50, 0, &delayed) == 0);
+    CHECK(thread_pool_future_wait(delayed) == (void *)7);
+    elapsed = now_ms() - start;
+    thread_pool_future_release(delayed);
+    CHECK(elapsed >= 50);
+    printf("delayed: ran after %llu ms\n", (unsigned long long)elapsed);
+
+    CHECK(thread_pool_schedule(pool, tick_task, NULL, 10, 20, &periodic) == 0);
+    usleep(230000);
+    CHECK(!thread_pool_future_done(periodic));
+    thread_pool_cancel(pool, periodic);
+    CHECK(thread_pool_future_wait(periodic) == NULL);
+    thread_pool_future_release(periodic);
+    seen = atomic_load(&ticks);
+    CHECK(seen >= 2);
+
+    usleep(60000);
+    CHECK(atomic_load(&ticks) == seen);
+    printf("periodic: %d runs, none after cancel\n", seen);
+}
+
+static void test_destroy(void)
+{
+    struct thread_pool_future *delayed;
+    long expected;
+    int i;
+
+    CHECK(thread_pool_schedule(pool, tick_task, NULL, 100000, 0, &delayed) == 0);
+    CHECK(thread_pool_schedule(pool, tick_task, NULL, 100000, 5, NULL) == 0);
+    expected = atomic_load(&counter) + TEST_TASKS;
+    for (i = 0; i < TEST_TASKS; i++) {
+        CHECK(thread_pool_submit(pool, count_task, NULL, NULL) == 0);
+    }
+
+    thread_pool_destroy(pool);
+    pool = NULL;
+
+    CHECK(atomic_load(&counter) == expected);
+    CHECK(thread_pool_future_done(delayed));
+    CHECK(thread_pool_future_wait(delayed) == NULL);
+    thread_pool_future_release(delayed);
+    printf("destroy: queued tasks ran, timed tasks were cancelled\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int workers = argc > 1 ? atoi(argv[1]) : 4;
+
+    if (workers < 2) {
+        fprintf(stderr, "Usage: %s [workers >= 2]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    pool = thread_pool_create(workers);
+    CHECK(pool != NULL);
+
+    test_futures();
+    test_stealing();
+    test_timed();
+    test_destroy();
+    return EXIT_SUCCESS;
+}
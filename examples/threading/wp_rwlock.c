@@ -0,0 +1,88 @@
+#include "wp_rwlock.h"
+#include "futex.h"
+
+/*
+ * Every access is sequentially consistent: a writer publishing writers_waiting and then reading
+ * state must not be reordered against a reader dropping state and then reading writers_waiting,
+ * or both could miss the other and the writer would sleep with nobody left to wake it.
+ */
+
+void wp_rwlock_init(struct wp_rwlock *lock)
+{
+    atomic_init(&lock->state, 0);
+    atomic_init(&lock->writers_waiting, 0);
+    atomic_init(&lock->readers_sleeping, 0);
+    atomic_init(&lock->read_seq, 0);
+    atomic_init(&lock->write_seq, 0);
+}
+
+static int read_allowed(struct wp_rwlock *lock, uint32_t state)
+{
+    return !(state & WP_RWLOCK_WRITER) && atomic_load(&lock->writers_waiting) == 0;
+}
+
+void wp_rwlock_rdlock(struct wp_rwlock *lock)
+{
+    uint32_t state;
+    uint32_t seq;
+
+    for (;;) {
+        state = atomic_load(&lock->state);
+        if (read_allowed(lock, state)) {
+            if (atomic_compare_exchange_weak(&lock->state, &state, state + 1)) {
+                return;
+            }
+            continue;
+        }
+
+        seq = atomic_load(&lock->read_seq);
+        atomic_fetch_add(&lock->readers_sleeping, 1);
+        if (!read_allowed(lock, atomic_load(&lock->state))) {
+            futex_wait(&lock->read_seq, seq);
+        }
+        atomic_fetch_sub(&lock->readers_sleeping, 1);
+    }
+}
+
+void wp_rwlock_rdunlock(struct wp_rwlock *lock)
+{
+    /* The last reader out lets a waiting writer in */
+    if (atomic_fetch_sub(&lock->state, 1) == 1 && atomic_load(&lock->writers_waiting) > 0) {
+        atomic_fetch_add(&lock->write_seq, 1);
+        futex_wake(&lock->write_seq, 1);
+    }
+}
+
+void wp_rwlock_wrlock(struct wp_rwlock *lock)
+{
+    uint32_t state;
+    uint32_t seq;
+
+    atomic_fetch_add(&lock->writers_waiting, 1);
+    for (;;) {
+        state = 0;
+        if (atomic_compare_exchange_weak(&lock->state, &state, WP_RWLOCK_WRITER)) {
+            break;
+        }
+
+        seq = atomic_load(&lock->write_seq);
+        if (atomic_load(&lock->state) != 0) {
+            futex_wait(&lock->write_seq, seq);
+        }
+    }
+    atomic_fetch_sub(&lock->writers_waiting, 1);
+}
+
+void wp_rwlock_wrunlock(struct wp_rwlock *lock)
+{
+    atomic_store(&lock->state, 0);
+
+    /* Hand over to the next writer if there is one, readers go once no writer waits */
+    if (atomic_load(&lock->writers_waiting) > 0) {
+        atomic_fetch_add(&lock->write_seq, 1);
+        futex_wake(&lock->write_seq, 1);
+    } else if (atomic_load(&lock->readers_sleeping) > 0) {
+        atomic_fetch_add(&lock->read_seq, 1);
+        futex_wake(&lock->read_seq, INT_MAX);
+    }
+}
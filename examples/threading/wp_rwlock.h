@@ -0,0 +1,40 @@
+#ifndef WP_RWLOCK_H
+#define WP_RWLOCK_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * Set in wp_rwlock.state while a writer holds the lock, the other bits count readers.
+ */
+#define WP_RWLOCK_WRITER 0x80000000u
+
+/**
+ * A writer-preferring reader-writer lock on futexes.  New readers wait as soon as a writer is
+ * waiting, so a steady stream of readers on a read-mostly path cannot starve writers the way
+ * the default pthread_rwlock_t does.
+ *
+ * Sleepers wait on read_seq or write_seq, which are bumped after every state change that may
+ * let them in, and a wake is only issued when the matching sleeper count is nonzero.
+ */
+struct wp_rwlock {
+    _Atomic uint32_t state;
+    _Atomic uint32_t writers_waiting;
+    _Atomic uint32_t readers_sleeping;
+    _Atomic uint32_t read_seq;
+    _Atomic uint32_t write_seq;
+};
+
+#define WP_RWLOCK_INITIALIZER { 0, 0, 0, 0, 0 }
+
+void wp_rwlock_init(struct wp_rwlock *lock);
+
+void wp_rwlock_rdlock(struct wp_rwlock *lock);
+
+void wp_rwlock_rdunlock(struct wp_rwlock *lock);
+
+void wp_rwlock_wrlock(struct wp_rwlock *lock);
+
+void wp_rwlock_wrunlock(struct wp_rwlock *lock);
+
+#endif
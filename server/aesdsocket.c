@@ -1,3 +1,4 @@
+#define _GNU_SOURCE /* splice() */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,10 +12,13 @@
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <pthread.h>
 
 #include "read_line.h"
 #include "queue.h"
+#include "profiled_mutex.h"
+#include "thread_pool.h"
 
 #include "aesd_ioctl.h"
 
@@ -51,12 +55,10 @@ struct list_data_s {
 /* Filestore types */
 typedef struct file_store_s {
     int fd;
-    pthread_mutex_t file_mutex; 
+    struct profiled_mutex file_mutex;
 } file_store_t;
 
 file_store_t filestore;
-#else 
-pthread_mutex_t file_mutex; 
 #endif
 
 int server_sock = -1;
@@ -79,7 +81,7 @@ int init_filestore() {
         return -1;
     }
 
-    if (pthread_mutex_init(&(filestore.file_mutex), NULL) == -1) {
+    if (profiled_mutex_init(&(filestore.file_mutex), "filestore") != 0) {
         close(filestore.fd);
         return -1;
     }
@@ -89,7 +91,7 @@ int init_filestore() {
 
 int filestore_write(char* data, size_t len) {
 
-    int rc = pthread_mutex_lock(&(filestore.file_mutex));
+    int rc = profiled_mutex_lock(&(filestore.file_mutex));
     if ( rc != 0 ) {
         syslog(LOG_ERR, "Failed to acquire filestore mutex");
         return -1;
@@ -98,7 +100,7 @@ int filestore_write(char* data, size_t len) {
         syslog(LOG_ERR, "Failed to write to file: %s", strerror(errno));
         return -1;
     }
-    rc = pthread_mutex_unlock(&(filestore.file_mutex));
+    rc = profiled_mutex_unlock(&(filestore.file_mutex));
     if ( rc != 0 ) {
         syslog(LOG_ERR, "Failed to release filestore mutex");
         return -1;
@@ -112,7 +114,7 @@ int filestore_read_to_dest(int dest_fd) {
     size_t bytes_read;
     char file_buffer[1024];
     
-    int rc = pthread_mutex_lock(&(filestore.file_mutex));
+    int rc = profiled_mutex_lock(&(filestore.file_mutex));
     if ( rc != 0 ) {
         syslog(LOG_ERR, "Failed to acquire filestore mutex");
         ret = -1;
@@ -129,7 +131,7 @@ int filestore_read_to_dest(int dest_fd) {
             syslog(LOG_ERR, "Failed to read from file: %s", strerror(errno));
             ret = -1;
         }
-        rc = pthread_mutex_unlock(&(filestore.file_mutex));
+        rc = profiled_mutex_unlock(&(filestore.file_mutex));
         if ( rc != 0 ) {
             syslog(LOG_ERR, "Failed to release filestore mutex");
             ret =  -1;
@@ -149,68 +151,150 @@ void filestore_close() {
     //free(filestore);
 }
 #else
-int filestore_write(char* data, size_t len) {
-    int fd;
-
-    int rc = pthread_mutex_lock(&file_mutex);
-    if ( rc != 0 ) {
-        syslog(LOG_ERR, "Failed to acquire filestore mutex");
-        return -1;
-    }
-
-    fd = open(CONNECTION_DATA_FILE, O_WRONLY);
-	lseek(fd, 0, SEEK_END);
+/* Each connection writes through its own open of the device, held until the
+   connection closes, so a line the driver has not seen the end of stays in
+   that file's pending line instead of mixing with other connections.  The
+   driver orders writes and replays under its own lock, so no userspace lock
+   is taken on the device path. */
+int filestore_open_writer(void) {
+    int fd = open(CONNECTION_DATA_FILE, O_WRONLY);
+    if (fd == -1) {
+        syslog(LOG_ERR, "Failed to open file: %s", strerror(errno));
+    }
+    return fd;
+}
 
+int filestore_write(int fd, char* data, size_t len) {
     if (write(fd, data, len) == -1) {
         syslog(LOG_ERR, "Failed to write to file: %s", strerror(errno));
         return -1;
     }
-    rc = pthread_mutex_unlock(&file_mutex);
-    if ( rc != 0 ) {
-        syslog(LOG_ERR, "Failed to release filestore mutex");
-        return -1;
+    return 0;
+}
+
+/* Send the device contents straight from a read-only mapping of the device.
+   Returns 0 on success, 1 if the device cannot be mapped so the caller should
+   fall back to read(), -1 on send failure */
+static int send_from_mapping(int fd, int dest_fd) {
+    long page_size = sysconf(_SC_PAGESIZE);
+    size_t map_len = page_size;
+    size_t full_len;
+    const struct aesd_mmap_header *header;
+    const char *data;
+    size_t sent = 0;
+    int attempts;
+
+    /* The first mapping only covers the header page, remap once the full length is known.
+       Retry if the device changed in between and the snapshot no longer fits. */
+    for (attempts = 0; attempts < 4; attempts++) {
+        header = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, 0);
+        if (header == MAP_FAILED) {
+            if (attempts == 0) {
+                return 1;
+            }
+            map_len = page_size;
+            continue;
+        }
+        if (header->data_offset + header->data_size <= map_len) {
+            break;
+        }
+        full_len = header->data_offset + header->data_size;
+        munmap((void *)header, map_len);
+        map_len = full_len;
+        header = MAP_FAILED;
     }
-    
-    close(fd);
+    if (header == MAP_FAILED) {
+        return 1;
+    }
+
+    data = (const char *)header + header->data_offset;
+    while (sent < header->data_size) {
+        ssize_t rc = send(dest_fd, data + sent, header->data_size - sent, 0);
+        if (rc == -1) {
+            syslog(LOG_ERR, "Failed to send data to client: %s", strerror(errno));
+            munmap((void *)header, map_len);
+            return -1;
+        }
+        sent += rc;
+    }
+
+    munmap((void *)header, map_len);
     return 0;
 }
 
+/* Move the device contents to the socket through a pipe with splice(), so the
+   data never passes through user space.
+   Returns 0 on success, 1 if the device does not support splice so the caller
+   should fall back to another method, -1 on failure */
+static int send_by_splice(int fd, int dest_fd) {
+    int pipe_fds[2];
+    ssize_t in_pipe;
+    ssize_t rc;
+    bool sent_any = false;
+    int ret = 0;
+
+    if (pipe(pipe_fds) == -1) {
+        return 1;
+    }
+
+    while ((in_pipe = splice(fd, NULL, pipe_fds[1], NULL, CONNECTION_BUFFER_SIZE, SPLICE_F_MOVE)) != 0) {
+        if (in_pipe == -1) {
+            if (!sent_any && errno == EINVAL) {
+                ret = 1;
+            } else {
+                syslog(LOG_ERR, "Failed to splice from file: %s", strerror(errno));
+                ret = -1;
+            }
+            break;
+        }
+        sent_any = true;
+
+        while (in_pipe > 0) {
+            rc = splice(pipe_fds[0], NULL, dest_fd, NULL, in_pipe, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (rc <= 0) {
+                syslog(LOG_ERR, "Failed to splice data to client: %s", strerror(errno));
+                ret = -1;
+                goto exit;
+            }
+            in_pipe -= rc;
+        }
+    }
+
+exit:
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    return ret;
+}
+
 int filestore_read_to_dest(int dest_fd) {
     int fd;
     int ret = 0;
     size_t bytes_read;
     char file_buffer[1024];
 
-    int rc = pthread_mutex_lock(&file_mutex);
-    if ( rc != 0 ) {
-        syslog(LOG_ERR, "Failed to acquire filestore mutex");
+    fd = open(CONNECTION_DATA_FILE, O_RDONLY);
+    if(fd == -1) {
+        syslog(LOG_ERR, "Failed to send data to client: %s", strerror(errno));
         ret = -1;
     } else {
-        fd = open(CONNECTION_DATA_FILE, O_RDONLY);
-        if(fd == -1) {
-            syslog(LOG_ERR, "Failed to send data to client: %s", strerror(errno));
-            ret = -1;
-        }
-        lseek(fd, 0, SEEK_SET);
-        while ((bytes_read = read(fd, file_buffer, 1024)) > 0 && ret != -1) {
-            syslog(LOG_INFO, "Sending %s", file_buffer);
-            if (send(dest_fd, file_buffer, bytes_read, 0) == -1) {
-                syslog(LOG_ERR, "Failed to send data to client: %s", strerror(errno));
+        if ((ret = send_by_splice(fd, dest_fd)) == 1 &&
+            (ret = send_from_mapping(fd, dest_fd)) == 1) {
+            ret = 0;
+            lseek(fd, 0, SEEK_SET);
+            while ((bytes_read = read(fd, file_buffer, 1024)) > 0 && ret != -1) {
+                syslog(LOG_INFO, "Sending %s", file_buffer);
+                if (send(dest_fd, file_buffer, bytes_read, 0) == -1) {
+                    syslog(LOG_ERR, "Failed to send data to client: %s", strerror(errno));
+                    ret = -1;
+                }
+            }
+            if (bytes_read == -1UL) {
+                syslog(LOG_ERR, "Failed to read from file: %s", strerror(errno));
                 ret = -1;
             }
         }
-        if (bytes_read == -1UL) {
-            syslog(LOG_ERR, "Failed to read from file: %s", strerror(errno));
-            ret = -1;
-        }
-        rc = pthread_mutex_unlock(&file_mutex);
-        if ( rc != 0 ) {
-            syslog(LOG_ERR, "Failed to release filestore mutex");
-            ret =  -1;
-        }
         close(fd);
     }
-
     return ret;
 }
 
@@ -218,42 +302,64 @@ int filestore_read_to_dest(int dest_fd) {
 
 // Handling ioctl command
 #ifdef USE_AESD_CHAR_DEVICE
+/* Device descriptor shared by every connection for positional reads, opened on first use */
+static int aesd_fd = -1;
+static pthread_once_t aesd_fd_once = PTHREAD_ONCE_INIT;
+
+static void open_aesd_fd(void) {
+    /* Non-blocking, so a tail read at the end of the data returns instead of waiting for more */
+    aesd_fd = open(CONNECTION_DATA_FILE, O_RDONLY | O_NONBLOCK);
+    if (aesd_fd == -1) {
+        syslog(LOG_ERR, "Failed to open %s: %s", CONNECTION_DATA_FILE, strerror(errno));
+    }
+}
+
 static int handle_ioctl(int connection_fd, int cmd, int offset) {
-    int ret;
-    FILE *fp;
-    struct aesd_seekto seekto;
-    uint8_t buff[1024];
+    struct aesd_entry_table table;
+    struct aesd_tail_read tail;
+    uint8_t buff[CONNECTION_BUFFER_SIZE / 4];
+    ssize_t len;
+    ssize_t sent;
 
-    // Open file
-    if ((fp = fopen(CONNECTION_DATA_FILE, "w+")) == NULL) {
-        return errno;
+    pthread_once(&aesd_fd_once, open_aesd_fd);
+    if (aesd_fd == -1) {
+        return EBADF;
     }
 
-    syslog(LOG_INFO, "Setting up ioctl cmd %lu with struct arg : %d, %d", AESDCHAR_IOCSEEKTO, cmd, offset);
-    // Send ioct command
-    seekto.write_cmd = cmd;
-    seekto.write_cmd_offset = offset;
-    if ((ioctl(fileno(fp), AESDCHAR_IOCSEEKTO, &seekto)) != 0) {
+    syslog(LOG_INFO, "Setting up ioctl cmd %lu with struct arg : %d, %d", AESDCHAR_IOCTAILREAD, cmd, offset);
+    // Turn the position into an absolute offset, which keeps pointing at the same byte when
+    // later writes evict older entries, rejecting it like AESDCHAR_IOCSEEKTO would
+    if (ioctl(aesd_fd, AESDCHAR_IOCENTRIES, &table) == -1) {
         return errno;
     }
+    if (cmd < 0 || offset < 0 || (uint32_t)cmd >= table.count ||
+        (uint64_t)offset >= table.entries[cmd].size) {
+        return EINVAL;
+    }
 
-    // Send data back
-    while (!feof(fp)) {
-        size_t len = fread(buff, 1, sizeof(buff), fp);
-        if (ferror(fp) != 0) {
-            ret = errno;
-            goto exit;
+    // Each ioctl copies the data at the cursor straight into buff, leaving the shared file position alone
+    memset(&tail, 0, sizeof(tail));
+    tail.cursor = table.entries[cmd].offset + offset;
+    tail.buf = (uintptr_t)buff;
+    tail.len = sizeof(buff);
+    while ((len = ioctl(aesd_fd, AESDCHAR_IOCTAILREAD, &tail)) > 0) {
+        if (tail.skipped > 0) {
+            // The rest of the requested data was overwritten before it could be sent
+            return ENODATA;
         }
-
-        if (send(connection_fd, buff, len, 0) < 0) {
-            ret = errno;
-            goto exit;
+        for (sent = 0; sent < len; ) {
+            ssize_t rc = send(connection_fd, buff + sent, len - sent, 0);
+            if (rc < 0) {
+                return errno;
+            }
+            sent += rc;
         }
     }
 
-exit:
-    fclose(fp);
-    return ret;
+    if (len < 0 && errno != EAGAIN) {
+        return errno;
+    }
+    return 0;
 }
 #endif
 
@@ -270,6 +376,13 @@ void* handle_connection(void *thread_args) {
     inet_ntop(AF_INET, &(thread_func_args->client_addr), client_ip, INET_ADDRSTRLEN);
     syslog(LOG_INFO, "[Thread-%ld] Accepted connection from %s", thread_func_args->thread, client_ip);
 
+#ifdef USE_AESD_CHAR_DEVICE
+    int writer_fd = filestore_open_writer();
+    if (writer_fd == -1) {
+        operation_failed = true;
+    }
+#endif
+
     /* Handling data */
     while(((bytes_received = read_line(thread_func_args->connection_fd, conn_buffer, CONNECTION_BUFFER_SIZE)) > 0 && !should_terminate) && !operation_failed) {
         syslog(LOG_DEBUG, "[Thread-%ld] Newline found", thread_func_args->thread); 
@@ -291,7 +404,11 @@ void* handle_connection(void *thread_args) {
             continue;
         } else {
 #endif
+#ifdef USE_AESD_CHAR_DEVICE
+        if(filestore_write(writer_fd, conn_buffer, bytes_received) == -1) {
+#else
         if(filestore_write(conn_buffer, bytes_received) == -1) {
+#endif
             syslog(LOG_ERR, "[Thread-%ld] Write failed to filestore\n", thread_func_args->thread);
             operation_failed = true;
         }
@@ -310,6 +427,11 @@ void* handle_connection(void *thread_args) {
     }
 
     /* Closing connection */
+#ifdef USE_AESD_CHAR_DEVICE
+    if (writer_fd != -1) {
+        close(writer_fd);
+    }
+#endif
     close(thread_func_args->connection_fd);
     thread_func_args->thread_complete = true;
     /* Logging closed connection */
@@ -318,22 +440,17 @@ void* handle_connection(void *thread_args) {
     return thread_func_args;
 }
 
-/* Simplest solution*/
+/* Run every TIMER_SLEEP seconds by the timer pool */
 #ifndef USE_AESD_CHAR_DEVICE
-void* timer_thread(void *args) {
+void* write_timestamp(void *args) {
     char timestamp[100];
-    while (true) {
-        sleep(TIMER_SLEEP);
+    struct tm tm_info;
 
-        time_t now = time(NULL);
-        struct tm *tm_info = localtime(&now);
-        strftime(timestamp, sizeof(timestamp), "timestamp:%a, %d %b %Y %H:%M:%S %z\n", tm_info);
-        filestore_write(timestamp, strlen(timestamp));
-        
-    }
+    time_t now = time(NULL);
+    localtime_r(&now, &tm_info);
+    strftime(timestamp, sizeof(timestamp), "timestamp:%a, %d %b %Y %H:%M:%S %z\n", &tm_info);
+    filestore_write(timestamp, strlen(timestamp));
 
-    syslog(LOG_INFO, "Timer thread terminating...\n");
-    
     return args;
 }
 #endif
@@ -380,9 +497,9 @@ int main(int argc, char const *argv[]) {
     LIST_HEAD(listhead, list_data_s) head;
     LIST_INIT(&head);
 
-    /* timer thread */
+    /* timer pool */
 #ifndef USE_AESD_CHAR_DEVICE
-    pthread_t timer_thread_id;
+    struct thread_pool *timer_pool;
 #endif
     openlog(LOG_IDENTITY, LOG_PID, LOG_USER);
 
@@ -449,14 +566,25 @@ int main(int argc, char const *argv[]) {
         return EXIT_FAILURE;
     }
 
-    /* Init timer thread*/
+    /* Dump lock statistics on SIGUSR1, before any other thread exists so they all leave it
+       to the dump thread */
+    if (profiled_mutex_dump_on_signal(SIGUSR1, run_as_daemon ? -1 : STDERR_FILENO) != 0) {
+        syslog(LOG_ERR, "Failed to register SIGUSR1 lock statistics dump");
+    }
+
+    /* Init timer pool */
 #ifndef USE_AESD_CHAR_DEVICE
-    if(pthread_create(&timer_thread_id, NULL, timer_thread, NULL) == -1) {
-        syslog(LOG_ERR, "Failed to create timer thread: %s", strerror(errno));
-        
+    timer_pool = thread_pool_create(1);
+    if (timer_pool == NULL ||
+        thread_pool_schedule(timer_pool, write_timestamp, NULL, TIMER_SLEEP * 1000, TIMER_SLEEP * 1000, NULL) != 0) {
+        syslog(LOG_ERR, "Failed to start timestamp timer: %s", strerror(errno));
+        if (timer_pool != NULL) {
+            thread_pool_destroy(timer_pool);
+        }
+
         closelog();
         filestore_close();
-        
+
         return EXIT_FAILURE;
     }
 #endif
@@ -569,8 +697,11 @@ int main(int argc, char const *argv[]) {
         close(server_sock);
     }
 #ifndef USE_AESD_CHAR_DEVICE
-    pthread_cancel(timer_thread_id);
-    pthread_join(timer_thread_id, NULL);
+    thread_pool_destroy(timer_pool);
+#else
+    if (aesd_fd != -1) {
+        close(aesd_fd);
+    }
 #endif
     syslog(LOG_INFO, "Server exiting\n");
     closelog();
@@ -0,0 +1,161 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../../examples/systemcalls/systemcalls.h"
+
+/* Appends a line to the marker file named by $0 when the command starts and another when it ends */
+#define MARKER_NAP "echo start >> \"$0\"; sleep 0.5; echo end >> \"$0\""
+
+static void make_marker_file(char *path)
+{
+    int fd = mkstemp(path);
+
+    TEST_ASSERT_TRUE_MESSAGE(fd != -1, "A marker file can be created");
+    close(fd);
+}
+
+/**
+* @return the most commands the start and end lines of the marker file at path show running at
+* once, after checking it holds count of each
+*/
+static int max_running(const char *path, int count)
+{
+    FILE *markers = fopen(path, "r");
+    char line[16];
+    int running = 0;
+    int most = 0;
+    int starts = 0;
+    int ends = 0;
+
+    TEST_ASSERT_NOT_NULL(markers);
+    while (fgets(line, sizeof(line), markers) != NULL) {
+        if (strcmp(line, "start\n") == 0) {
+            starts++;
+            running++;
+            if (running > most) {
+                most = running;
+            }
+        } else {
+            TEST_ASSERT_EQUAL_STRING("end\n", line);
+            ends++;
+            running--;
+        }
+    }
+    fclose(markers);
+    TEST_ASSERT_EQUAL_INT(count, starts);
+    TEST_ASSERT_EQUAL_INT(count, ends);
+    return most;
+}
+
+/**
+* Every command gets its own stdout and stderr, including output larger than a pipe buffer, and
+* the status it exited with.
+*/
+void test_exec_batch_captures_output()
+{
+    char *const echo[] = { "/bin/echo", "hello", NULL };
+    char *const both[] = { "/bin/sh", "-c", "echo out; echo err >&2", NULL };
+    char *const large[] = { "/bin/sh", "-c", "head -c 1000000 /dev/zero", NULL };
+    char *const *const commands[] = { echo, both, large };
+    struct exec_batch_result results[3];
+
+    TEST_ASSERT_TRUE_MESSAGE(do_exec_batch(commands, 3, 2, results),
+            "Every command exits with status 0");
+
+    TEST_ASSERT_EQUAL_INT(0, results[0].status);
+    TEST_ASSERT_EQUAL_STRING("hello\n", results[0].out);
+    TEST_ASSERT_EQUAL_UINT(0, results[0].err_len);
+    TEST_ASSERT_EQUAL_STRING("out\n", results[1].out);
+    TEST_ASSERT_EQUAL_STRING("err\n", results[1].err);
+    TEST_ASSERT_EQUAL_UINT(1000000, results[2].out_len);
+
+    exec_batch_free_results(results, 3);
+}
+
+/**
+* With a parallelism of 2, no more than two of four commands overlap, with 4 all of them do.
+* Overlap is read from the start and end lines the commands append to a marker file.
+*/
+void test_exec_batch_parallelism_limit()
+{
+    char path[] = "/tmp/exec_batch_markersXXXXXX";
+    char *const nap[] = { "/bin/sh", "-c", MARKER_NAP, path, NULL };
+    char *const *const commands[] = { nap, nap, nap, nap };
+    struct exec_batch_result results[4];
+
+    make_marker_file(path);
+
+    TEST_ASSERT_TRUE(do_exec_batch(commands, 4, 2, results));
+    exec_batch_free_results(results, 4);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(2, max_running(path, 4), "At most 2 commands run at once");
+
+    TEST_ASSERT_EQUAL_INT(0, truncate(path, 0));
+    TEST_ASSERT_TRUE(do_exec_batch(commands, 4, 4, results));
+    exec_batch_free_results(results, 4);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(4, max_running(path, 4), "All 4 commands run at once");
+
+    unlink(path);
+}
+
+/**
+* A failing command fails the batch without stopping the others, a command which cannot be
+* started keeps the status -1.
+*/
+void test_exec_batch_failure_status()
+{
+    char *const fail[] = { "/bin/sh", "-c", "exit 3", NULL };
+    char *const echo[] = { "/bin/echo", "still runs", NULL };
+    char *const missing[] = { "/nonexistent/command", NULL };
+    char *const *const commands[] = { fail, echo, missing };
+    struct exec_batch_result results[3];
+
+    TEST_ASSERT_FALSE(do_exec_batch(commands, 3, 3, results));
+
+    TEST_ASSERT_TRUE(WIFEXITED(results[0].status));
+    TEST_ASSERT_EQUAL_INT(3, WEXITSTATUS(results[0].status));
+    TEST_ASSERT_EQUAL_INT(0, results[1].status);
+    TEST_ASSERT_EQUAL_STRING("still runs\n", results[1].out);
+    TEST_ASSERT_EQUAL_INT(-1, results[2].status);
+
+    exec_batch_free_results(results, 3);
+}
+
+/**
+* A command closing its output long before it exits does not hold up the others, and its own
+* run time covers it until its exit.  The other commands share the second slot, so all three
+* append to the marker file before the closing command only if each is reaped as soon as it exits.
+*/
+void test_exec_batch_early_close()
+{
+    char path[] = "/tmp/exec_batch_markersXXXXXX";
+    char *const closer[] = { "/bin/sh", "-c", "exec >&- 2>&-; sleep 1; echo closer >> \"$0\"", path, NULL };
+    char *const echo[] = { "/bin/sh", "-c", "echo quick; echo quick >> \"$0\"", path, NULL };
+    char *const *const commands[] = { closer, echo, echo, echo };
+    struct exec_batch_result results[4];
+    char markers[64] = "";
+    FILE *file;
+    int i;
+
+    make_marker_file(path);
+    TEST_ASSERT_TRUE(do_exec_batch(commands, 4, 2, results));
+
+    TEST_ASSERT_TRUE_MESSAGE(results[0].elapsed_ms >= 1000,
+            "The run time of the closing command lasts until it exits");
+    for (i = 1; i < 4; i++) {
+        TEST_ASSERT_EQUAL_STRING("quick\n", results[i].out);
+        TEST_ASSERT_TRUE_MESSAGE(results[i].elapsed_ms < 10000,
+                "Commands next to the closing one finish");
+    }
+    exec_batch_free_results(results, 4);
+
+    file = fopen(path, "r");
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT_TRUE(fread(markers, 1, sizeof(markers) - 1, file) > 0);
+    fclose(file);
+    unlink(path);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("quick\nquick\nquick\ncloser\n", markers,
+            "Commands next to the closing one are reaped as soon as they exit");
+}